@@ -0,0 +1,139 @@
+/*
+ * bench.c: timing probes of the rendering code and their report
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench.h"
+
+boolean_t bench_enabled = FALSE;
+static long long launched = 0;		// When the game was started
+static long long first_frame = 0;	// When something was sent for the first time
+
+static bench_probe_t probes[BENCH_NPROBES] = {
+	{ "render_resource", 0, 0, 0 },
+	{ "animate_card",    0, 0, 0 },
+	{ "update_cards",    0, 0, 0 },
+	{ "do_exposure",     0, 0, 0 },
+};
+
+/*
+ *
+ * Return the time elapsed since an arbitrary point of the past, in nanoseconds.
+ * Unlike get_time_usecs(), this is always the system clock, even when the
+ * game runs on a simulated one.
+ *
+ */
+long long bench_time_nsecs(void)
+{
+	struct timespec ts;
+
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ *
+ * Record that the game has just been started, which is where the time to the
+ * first frame is measured from. This is done whether a benchmark is to be
+ * run or not, since it is known only once the command line is parsed.
+ *
+ */
+void bench_launch(void)
+{
+	launched = bench_time_nsecs();
+}
+
+/*
+ *
+ * Record the time of the first frame sent through @fr, if it has just been
+ * flushed, once it has reached its destination. Called after each flush,
+ * this costs a test once the time is known.
+ *
+ */
+void bench_firstframe(render_frame_t *fr)
+{
+	if (!first_frame && fr->frames) {
+		render_finish(fr);
+		first_frame = bench_time_nsecs();
+	}
+}
+
+/*
+ *
+ * Account a call to the function measured by the probe @id, which started
+ * at @t0 as returned by bench_time_nsecs().
+ *
+ */
+void bench_stop(bench_probe_id_t id, long long t0)
+{
+	long long t = bench_time_nsecs() - t0;
+
+
+	probes[id].calls++;
+	probes[id].nsecs += t;
+	if (t > probes[id].max)
+		probes[id].max = t;
+}
+
+/*
+ *
+ * Write the results of the benchmark to @filename as a JSON object: the
+ * @seed the hand was dealt with and the number of @turns played, how long
+ * it took from launch to the first frame, how many frames were sent through
+ * @fr and the requests it took, and the calls and times in microseconds of
+ * each probe.
+ * Return 0 on success or -1 if the file could not be written.
+ *
+ */
+int bench_report(const char *filename, render_frame_t *fr, long seed, unsigned turns)
+{
+	FILE *fp = NULL;
+	unsigned i;
+
+
+	fp = fopen(filename, "w");
+	if (!fp) {
+		perror(filename);
+		return -1;
+	}
+
+	render_finish(fr);
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"backend\": \"%s\",\n", fr->backend->name);
+	fprintf(fp, "  \"seed\": %ld,\n", seed);
+	fprintf(fp, "  \"turns\": %u,\n", turns);
+	fprintf(fp, "  \"first_frame_ms\": %.3f,\n", first_frame ? (first_frame - launched) / 1000000.0 : 0.0);
+	fprintf(fp, "  \"frames\": %lu,\n", fr->frames);
+	fprintf(fp, "  \"requests\": %lu,\n", fr->requests);
+	fprintf(fp, "  \"requests_per_frame\": %.3f,\n", fr->frames ? (double)fr->requests / fr->frames : 0.0);
+	fprintf(fp, "  \"probes\": {\n");
+	for (i=0;i<BENCH_NPROBES;i++) {
+		fprintf(fp, "    \"%s\": { \"calls\": %lu, \"total_us\": %.3f, \"mean_us\": %.3f, \"max_us\": %.3f }%s\n",
+			probes[i].name, probes[i].calls, probes[i].nsecs / 1000.0,
+			probes[i].calls ? probes[i].nsecs / 1000.0 / probes[i].calls : 0.0,
+			probes[i].max / 1000.0, i + 1 < BENCH_NPROBES ? "," : "");
+	}
+	fprintf(fp, "  }\n");
+	fprintf(fp, "}\n");
+
+	return fclose(fp) ? -1 : 0;
+}
@@ -0,0 +1,55 @@
+/*
+ *
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _SRC_BENCH_H_
+#define _SRC_BENCH_H_
+#ifndef _HAVE_BOOLEAN_T_
+#define _HAVE_BOOLEAN_T_
+typedef enum { FALSE=0, TRUE } boolean_t;
+#endif
+#include "render.h"
+
+typedef enum {
+	BENCH_RENDER_RESOURCE=0,
+	BENCH_ANIMATE_CARD,
+	BENCH_UPDATE_CARDS,
+	BENCH_DO_EXPOSURE,
+	BENCH_NPROBES
+} bench_probe_id_t;
+
+typedef struct bench_probe_st {
+	const char *name;
+	unsigned long calls;
+	long long nsecs;		// Total time spent, callees included
+	long long max;			// Longest single call
+} bench_probe_t;
+
+extern boolean_t bench_enabled;
+
+// Probes cost a test of bench_enabled when benchmarks are not running
+#define BENCH_START(t)		((t) = bench_enabled ? bench_time_nsecs() : 0)
+#define BENCH_STOP(id, t)	do { if (bench_enabled) bench_stop(id, t); } while (0)
+
+extern long long bench_time_nsecs(void);
+extern void bench_launch(void);
+extern void bench_firstframe(render_frame_t *fr);
+extern void bench_stop(bench_probe_id_t id, long long t0);
+extern int bench_report(const char *filename, render_frame_t *fr, long seed, unsigned turns);
+#endif
@@ -299,9 +299,9 @@ digraph_table_t *digraph_create_table(dllst_t *playerlst)
 		}
 	}
 
-	while (dllst_delitem(lst2, 0)) {}
+	dllst_clear(lst2);
 	free(lst2);
-	while (dllst_delitem(lst, 0)) {}
+	dllst_clear(lst);
 	free(lst);
 
 	return table;
@@ -21,7 +21,6 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <limits.h>
 
 typedef enum { FALSE=0, TRUE } boolean_t;
 typedef enum { 	F_SIGNED_CHAR_T=0, F_UNSIGNED_CHAR_T, F_SIGNED_SHORT_T, \
@@ -39,13 +38,35 @@ typedef union {
 	double b;
 } largest_t;
 
+#define DLLST_POOL_CLASSES	8		// Chunks of 8 bytes up to 1 KiB, doubling in size
+#define DLLST_SLAB_SIZE		65536		// Bytes each slab takes from malloc()
+#define DLLST_CACHE_LINE	64		// Slabs start on a cache line, so that no chunk straddles two
+#define DLLST_MIN_INDEX		16		// Entries of the smallest index of a list
+#define DLLST_MAX_BUCKETS	256		// Widest range of values a key can be declared to take
+
+/*
+ *
+ * Items and their fields are carved out of slabs shared by every list, and
+ * deleted ones go back to the free list of their size class instead of to
+ * free(), so that lists which keep growing and shrinking stop calling
+ * malloc(). Records larger than the largest class are left to malloc().
+ * As lists themselves, the pool is not meant to be used by several threads
+ * at once.
+ *
+ */
+typedef struct dllst_chunk_st {
+	struct dllst_chunk_st *next;
+} dllst_chunk_t;
+
+typedef struct dllst_slab_st {
+	struct dllst_slab_st *next;
+	largest_t data[] __attribute__((aligned(DLLST_CACHE_LINE)));
+} dllst_slab_t;
+
 typedef struct dllst_item_struct {
-#if DEBUG_DLLST_SORTROUTINE
-	unsigned n;
-#endif
-	void *fields;
 	struct dllst_item_struct *prev;
 	struct dllst_item_struct *next;
+	unsigned char fields[] __attribute__((aligned(sizeof(largest_t))));	// Inline, right after the links
 } dllst_item_struct_t;
 
 typedef struct dllst_struct {
@@ -53,24 +74,45 @@ typedef struct dllst_struct {
 		field_type_t f_type;
 		unsigned f_size;
 		char *f_sprintf;
+		boolean_t f_ranged;	// Whether f_min and f_max were set by 'dllst_setrange'
+		long long f_min;
+		long long f_max;
 	} **f_info;
 	unsigned fields_no;
 	unsigned long size;
 	dllst_item_struct_t *head;
 	dllst_item_struct_t *tail;
+	size_t recsize;			// Bytes of the fields of each item
+	dllst_item_struct_t **index;	// Items by position, the first one at index[first]
+	unsigned long first;
+	unsigned long capacity;		// Entries allocated in index
 } dllst_t;
 
+typedef struct dllst_sortkey_st {
+	unsigned field;
+	boolean_t asc;
+} dllst_sortkey_t;
+
 boolean_t dllst_verbose = TRUE;
+static dllst_chunk_t *pool_free[DLLST_POOL_CLASSES];	// Free chunks of each size class
+static dllst_slab_t *pool_slabs = NULL;
 
 static void dbginfo_print(char *);
-static unsigned long dllst_findmin(dllst_t *l, void *, unsigned, unsigned long, boolean_t);
-static unsigned long dllst_findmax(dllst_t *l, void *, unsigned, unsigned long, boolean_t);
+static void *dllst_alloc(size_t size);
+static void dllst_release(void *ptr, size_t size);
+static int dllst_reserve(dllst_t *l);
 dllst_t *dllst_initlst(dllst_t *l, char *fields_info);
+int dllst_setrange(dllst_t *l, unsigned field, long long min, long long max);
 dllst_item_struct_t *dllst_newitem(dllst_t *l, void *fields);
 dllst_item_struct_t *dllst_delitem(dllst_t *l, unsigned long n);
 boolean_t dllst_isinlst(dllst_t *l, void *fields);
 void dllst_swapitems(dllst_t *l, unsigned long a, unsigned long b);
+static boolean_t dllst_bucket(dllst_t *l, unsigned field, void *fields, unsigned long *b);
+static boolean_t dllst_countingsort(dllst_t *l, const dllst_sortkey_t *keys, unsigned nkeys);
+void dllst_sortkeys(dllst_t *l, const dllst_sortkey_t *keys, unsigned nkeys);
 void dllst_sortby(dllst_t *l, unsigned field, boolean_t asc);
+void dllst_clear(dllst_t *l);
+void dllst_releasepool(void);
 
 static void dbginfo_print(char *s)
 {
@@ -78,6 +120,112 @@ static void dbginfo_print(char *s)
 		printf("%s\n", s);
 }
 
+/*
+ *
+ * Return the size class of chunks of @size bytes, or DLLST_POOL_CLASSES if
+ * they are too large to be pooled.
+ *
+ */
+static unsigned dllst_class(size_t size)
+{
+	unsigned c;
+
+
+	for (c=0;c<DLLST_POOL_CLASSES && (sizeof(largest_t) << c) < size;c++);
+
+	return c;
+}
+
+/*
+ *
+ * Take a chunk of @size bytes from the pool, carving a new slab into chunks
+ * of its class if none is free. Return NULL if no memory is available.
+ *
+ */
+static void *dllst_alloc(size_t size)
+{
+	dllst_chunk_t *chunk = NULL;
+	dllst_slab_t *slab = NULL;
+	unsigned c = dllst_class(size);
+	size_t csize = sizeof(largest_t) << c, n;
+
+
+	if (c == DLLST_POOL_CLASSES)
+		return malloc(size);
+
+	if (!pool_free[c]) {
+		if (posix_memalign((void **)&slab, DLLST_CACHE_LINE, DLLST_SLAB_SIZE))
+			return NULL;
+		slab->next = pool_slabs;
+		pool_slabs = slab;
+
+		// chunks are handed out in address order
+		for (n=(DLLST_SLAB_SIZE - sizeof(dllst_slab_t)) / csize;n>0;n--) {
+			chunk = (dllst_chunk_t *)((char *)slab->data + (n - 1) * csize);
+			chunk->next = pool_free[c];
+			pool_free[c] = chunk;
+		}
+	}
+
+	chunk = pool_free[c];
+	pool_free[c] = chunk->next;
+	return chunk;
+}
+
+/*
+ *
+ * Give back to the pool the chunk @ptr of @size bytes.
+ *
+ */
+static void dllst_release(void *ptr, size_t size)
+{
+	dllst_chunk_t *chunk = (dllst_chunk_t *)ptr;
+	unsigned c = dllst_class(size);
+
+
+	if (c == DLLST_POOL_CLASSES) {
+		free(ptr);
+		return;
+	}
+
+	chunk->next = pool_free[c];
+	pool_free[c] = chunk;
+}
+
+/*
+ *
+ * Make room in the index of @l for one more item after the last one, either
+ * by moving the entries back to the start of the index, if items deleted
+ * from the head left at least as many entries unused as there are items,
+ * or by doubling the index. Return 0 on success or -1 if no memory is
+ * available.
+ *
+ */
+static int dllst_reserve(dllst_t *l)
+{
+	dllst_item_struct_t **index = NULL;
+	unsigned long capacity;
+
+
+	if (l->first + l->size < l->capacity)
+		return 0;
+
+	if (l->first && l->first >= l->size) {
+		memmove(l->index, l->index + l->first, l->size * sizeof(dllst_item_struct_t *));
+		l->first = 0;
+		return 0;
+	}
+
+	capacity = l->capacity ? l->capacity * 2 : DLLST_MIN_INDEX;
+	index = (dllst_item_struct_t **)realloc(l->index, capacity * sizeof(dllst_item_struct_t *));
+	if (!index)
+		return -1;
+	l->index = index;
+	l->capacity = capacity;
+
+	return 0;
+}
+
 /**
  *
  * dllst_initlst() -	Create a new double-linked list
@@ -193,6 +341,11 @@ case letter: \
 				dbginfo_print(debug);
 			}
 
+			// every field takes the same room, so items are copied in one go
+			l->recsize = 0;
+			for (i=0;i<l->fields_no;i++)
+				l->recsize += l->f_info[i]->f_size;
+
 			l->size = 0;
 			l->head = NULL;
 			l->tail = NULL;
@@ -211,6 +364,53 @@ oom_return:
 #undef ADD_CASE_F_INFO
 }
 
+/**
+ *
+ * dllst_setrange() -	Declare the range of values a field takes
+ * @l:			Pointer to the list
+ * @field:		the field, which must be of an integer type
+ * @min:		the smallest value the field takes
+ * @max:		the largest one
+ *
+ * Lists sorted only by fields whose range is declared, and no wider than
+ * DLLST_MAX_BUCKETS values, are sorted by 'dllst_sortkeys' in linear time,
+ * e.g., card numbers or suits. Items whose field lies outside of the range
+ * are not an error, they just make the list be sorted as any other one.
+ * Return 0 on success or -1 if the field is not an integer or the range is
+ * too wide.
+ *
+ */
+int dllst_setrange(dllst_t *l, unsigned field, long long min, long long max)
+{
+	if (!l || field >= l->fields_no || min > max ||
+	    (unsigned long long)max - (unsigned long long)min >= DLLST_MAX_BUCKETS) {
+		dbginfo_print("Invalid range");
+		return -1;
+	}
+
+	switch (l->f_info[field]->f_type) {
+	case F_SIGNED_CHAR_T:
+	case F_UNSIGNED_CHAR_T:
+	case F_SIGNED_SHORT_T:
+	case F_UNSIGNED_SHORT_T:
+	case F_SIGNED_INT_T:
+	case F_UNSIGNED_INT_T:
+	case F_SIGNED_LONG_T:
+	case F_UNSIGNED_LONG_T:
+	case F_SIGNED_LONG_LONG_T:
+	case F_UNSIGNED_LONG_LONG_T:
+		break;
+	default:
+		dbginfo_print("Ranges apply to integer fields only");
+		return -1;
+	};
+
+	l->f_info[field]->f_min = min;
+	l->f_info[field]->f_max = max;
+	l->f_info[field]->f_ranged = TRUE;
+	return 0;
+}
+
 /**
  *
  * dllst_newitem() -	Add a new item to the list
@@ -225,56 +425,17 @@ oom_return:
  */
 dllst_item_struct_t *dllst_newitem(dllst_t *l, void *fields)
 {
-	int i, j = 0;
 	dllst_item_struct_t *item = NULL, *prev = NULL;
 
 	if (l) {
 		prev = l->tail;
-		item = prev ? l->tail->next : l->tail;
 
-		item = (dllst_item_struct_t *)calloc(1, sizeof(dllst_item_struct_t));
+		// the fields are stored right after the links, in the same allocation
+		item = NULL;
+		if (!dllst_reserve(l))
+			item = (dllst_item_struct_t *)dllst_alloc(sizeof(dllst_item_struct_t) + l->recsize);
 		if (item) {
-			for (i=0;i<l->fields_no;i++)
-				j += l->f_info[i]->f_size;
-
-#define ADD_CASE_F_VALUE(type) \
-case type: \
-	*((largest_t *)item->fields + i) = *((largest_t *)fields + i); \
-	break;
-			item->fields = (void *)calloc(1, j);
-			if (item->fields) {
-				for (i=0;i<l->fields_no;i++) {
-					switch (l->f_info[i]->f_type) {
-					ADD_CASE_F_VALUE(F_SIGNED_CHAR_T)
-					ADD_CASE_F_VALUE(F_UNSIGNED_CHAR_T)
-					ADD_CASE_F_VALUE(F_SIGNED_SHORT_T)
-					ADD_CASE_F_VALUE(F_UNSIGNED_SHORT_T)
-					ADD_CASE_F_VALUE(F_SIGNED_INT_T)
-					ADD_CASE_F_VALUE(F_UNSIGNED_INT_T)
-					ADD_CASE_F_VALUE(F_SIGNED_LONG_T)
-					ADD_CASE_F_VALUE(F_UNSIGNED_LONG_T)
-					ADD_CASE_F_VALUE(F_SIGNED_LONG_LONG_T)
-					ADD_CASE_F_VALUE(F_UNSIGNED_LONG_LONG_T)
-					ADD_CASE_F_VALUE(F_FLOAT_T)
-					ADD_CASE_F_VALUE(F_DOUBLE_T)
-					ADD_CASE_F_VALUE(F_STRING_T)
-					ADD_CASE_F_VALUE(F_SIGNED_SHORT_PTR_T)
-					ADD_CASE_F_VALUE(F_UNSIGNED_SHORT_PTR_T)
-					ADD_CASE_F_VALUE(F_SIGNED_INT_PTR_T)
-					ADD_CASE_F_VALUE(F_UNSIGNED_INT_PTR_T)
-					ADD_CASE_F_VALUE(F_SIGNED_LONG_PTR_T)
-					ADD_CASE_F_VALUE(F_UNSIGNED_LONG_PTR_T)
-					ADD_CASE_F_VALUE(F_SIGNED_LONG_LONG_PTR_T)
-					ADD_CASE_F_VALUE(F_UNSIGNED_LONG_LONG_PTR_T)
-					ADD_CASE_F_VALUE(F_FLOAT_PTR_T)
-					ADD_CASE_F_VALUE(F_DOUBLE_PTR_T)
-					ADD_CASE_F_VALUE(F_VOID_PTR_T)
-					};
-				}
-			} else {
-				dbginfo_print("No memory available");
-				return NULL;
-			}
+			memcpy(item->fields, fields, l->recsize);
 
 			item->next = NULL;
 			if (!l->size) {
@@ -288,9 +449,7 @@ case type: \
 			}
 
 			l->tail = item;
-#if DEBUG_DLLST_SORTROUTINE
-			item->n = l->size;
-#endif
+			l->index[l->first + l->size] = item;
 			l->size++;
 			return item;
 		} else {
@@ -301,8 +460,6 @@ case type: \
 		dbginfo_print("Nothing done");
 		return NULL;
 	}
-
-#undef ADD_CASE_F_VALUE
 }
 
 /**
@@ -311,41 +468,22 @@ case type: \
  * @l:			Pointer to the list
  * @n:			the nth item to get an iterator
  *
+ * Items are looked up in the index of the list, in constant time.
+ *
  */
 dllst_item_struct_t *dllst_getitem(dllst_t *l, unsigned long n)
 {
-        long i;
-        char str[128] = { '\0' };
-        dllst_item_struct_t *item = NULL;
-
-        if (l) {
-                if (!n)
-                        return l->head;
-
-                if (n < l->size) {
-                        // Choose the shortest path from <head | tail> until 'n'
-                        if ((l->size - 1) - n > n) {
-                                sprintf(str, "Iterating over the list from head until %lu (size = %lu)", n, l->size);
-                                dbginfo_print(str);
-                                item = l->head;
-                                for (i=0;i<n;i++)
-                                        item = item->next;
-                        } else {
-                                sprintf(str, "Iterating over the list from tail (%lu) until %lu", l->size - 1, n);
-                                dbginfo_print(str);
-                                item = l->tail;
-                                for (i=(l->size - 1);i>n;i--)
-                                        item = item->prev;
-                        }
-                        return item;
-                } else {
-                        dbginfo_print("Requested item is out of range");
-                        return NULL;
-                }
-        }
-
-        dbginfo_print("Nothing done");
-        return NULL;
+	if (l) {
+		if (n < l->size)
+			return l->index[l->first + n];
+
+		if (n)
+			dbginfo_print("Requested item is out of range");
+		return NULL;
+	}
+
+	dbginfo_print("Nothing done");
+	return NULL;
 }
 
 /**
@@ -365,6 +503,7 @@ dllst_item_struct_t *dllst_delitem(dllst_t *l, unsigned long n)
 			item = l->head;
 			if (item) {
 				l->size--;
+				l->first = l->size ? l->first + 1 : 0;
 				l->head = item->next;
 
 				// warn if list is empty
@@ -373,9 +512,7 @@ dllst_item_struct_t *dllst_delitem(dllst_t *l, unsigned long n)
 				else
 					l->tail = NULL;
 
-				free(item->fields);
-				item->fields = NULL;
-				free(item);
+				dllst_release(item, sizeof(dllst_item_struct_t) + l->recsize);
 				item = NULL;
 				sprintf(ch, "1st item deleted, head is %p", l->head);
 				dbginfo_print(ch);
@@ -392,10 +529,10 @@ dllst_item_struct_t *dllst_delitem(dllst_t *l, unsigned long n)
 					prev->next = NULL;
 					l->tail = prev;
 				}
-				free(item->fields);
-				item->fields = NULL;
-				free(item);
+				dllst_release(item, sizeof(dllst_item_struct_t) + l->recsize);
 				item = NULL;
+				memmove(l->index + l->first + n, l->index + l->first + n + 1,
+					(l->size - n - 1) * sizeof(dllst_item_struct_t *));
 				l->size--;
 				sprintf(ch, "%lu-th item deleted", n);
 				dbginfo_print(ch);
@@ -412,6 +549,59 @@ dllst_item_struct_t *dllst_delitem(dllst_t *l, unsigned long n)
 	return NULL;
 }
 
+/**
+ *
+ * dllst_clear() -	Remove every item of a list at once
+ * @l:			Pointer to the list
+ *
+ * Items go back to the pool in a single pass, instead of being looked up and
+ * unlinked one at a time as 'dllst_delitem' does, and the index of the list
+ * is freed. The list is left empty and can be used again.
+ *
+ */
+void dllst_clear(dllst_t *l)
+{
+	dllst_item_struct_t *item = NULL, *next = NULL;
+
+
+	if (!l)
+		return;
+
+	for (item=l->head;item;item=next) {
+		next = item->next;
+		dllst_release(item, sizeof(dllst_item_struct_t) + l->recsize);
+	}
+	free(l->index);
+	l->index = NULL;
+	l->first = 0;
+	l->capacity = 0;
+	l->head = NULL;
+	l->tail = NULL;
+	l->size = 0;
+}
+
+/**
+ *
+ * dllst_releasepool() -	Give the memory of deleted items back to the system
+ *
+ * Every slab items are carved out of is freed, so this must only be called
+ * once no list holds any item (e.g., on exit, or after a burst of lists has
+ * been cleared).
+ *
+ */
+void dllst_releasepool(void)
+{
+	dllst_slab_t *slab = NULL;
+
+
+	while (pool_slabs) {
+		slab = pool_slabs;
+		pool_slabs = slab->next;
+		free(slab);
+	}
+	memset(pool_free, 0, sizeof(pool_free));
+}
+
 /**
  *
  * dllst_isinlst() -	Determine wether or not @fields are on the list
@@ -541,271 +731,274 @@ void dllst_swapitems(dllst_t *l, unsigned long a, unsigned long b)
 			item->next = NULL;
 			l->tail = item;
 		}
+
+		l->index[l->first + a] = next;
+		l->index[l->first + b] = item;
 	}
 }
 
-/**
- *
- * dllst_sortby() -	Order a list by specified key and direction	
- * @l:			Pointer to the list
- * @field:		the field used as a key 
- * @asc:		set to TRUE if ascending order is desired,
- *			FALSE otherwise
- *
- * Sort a list by an alternative algorithm to the well-known "bubble method",
- * which could be implemented using two nested loops.
+/*
  *
- * TODO: Add support for list ordering based on multiple comparison criteria
- * (e.g., sort by x (asc), then by y (des), and so on)
+ * Compare the fields @a and @b of two items of @l by the @nkeys keys at
+ * @keys, the first one which tells them apart deciding. Fields holding
+ * pointers, other than strings, never tell items apart. Return a negative
+ * number if @a goes first, a positive one if @b does, or 0 if they are
+ * equal by every key.
  *
  */
-void dllst_sortby(dllst_t *l, unsigned field, boolean_t asc)
+static int dllst_compare(dllst_t *l, const dllst_sortkey_t *keys, unsigned nkeys, void *a, void *b)
 {
-	dllst_item_struct_t *item = NULL, *preitem = NULL;
-	dllst_item_struct_t *next = NULL, *prenext = NULL, *temp = NULL;
-	unsigned long (*ascdes)(dllst_t *, void *, unsigned, unsigned long, boolean_t) = asc ? dllst_findmin : dllst_findmax;
-	unsigned long i = 0, j = 0, m = 0;
-#if DEBUG_DLLST_SORTROUTINE
-	dllst_item_struct_t *debug = NULL;
-	unsigned n;
-	char res[256] = { '\0' };
-#endif
-
-	if (l && l->size > 1) {
-		while (i < l->size) {
-			item = dllst_getitem(l, i);
-			while (item) {
-				m = ascdes(l, item->fields, field, j, j - i ? FALSE : TRUE);
-				j++;
-				item = item->next;
-			}
-
-			if (m != i) {
-				item    = dllst_getitem(l, i);
-				preitem = item->prev;
-				next    = dllst_getitem(l, m);
-				prenext = next->prev;
+	unsigned k;
+	int ret;
 
-				if (l->head == item)
-					l->head = next;
+#define DLLST_FIELD(p, f_type_p) \
+	(*((f_type_p *)(p) + keys[k].field * sizeof(largest_t) / sizeof(f_type_p)))
 
-				if (preitem)
-					preitem->next = next;
+#define ADD_CASE_KEY_COMPARISON(f_type, f_type_p) \
+case f_type: \
+	ret = (DLLST_FIELD(a, f_type_p) > DLLST_FIELD(b, f_type_p)) - \
+	      (DLLST_FIELD(a, f_type_p) < DLLST_FIELD(b, f_type_p)); \
+	break;
 
-				temp = item->next;
-				item->next = next->next;
-				next->next = (m - i) > 1 ? temp : item;
-				temp = item->prev;
-				item->prev = next->prev;
-				next->prev = (m - i) > 1 ? temp : preitem;
+	for (k=0;k<nkeys;k++) {
+		switch (l->f_info[keys[k].field]->f_type) {
+		ADD_CASE_KEY_COMPARISON(F_SIGNED_CHAR_T, char)
+		ADD_CASE_KEY_COMPARISON(F_UNSIGNED_CHAR_T, unsigned char)
+		ADD_CASE_KEY_COMPARISON(F_SIGNED_SHORT_T, short)
+		ADD_CASE_KEY_COMPARISON(F_UNSIGNED_SHORT_T, unsigned short)
+		ADD_CASE_KEY_COMPARISON(F_SIGNED_INT_T, int)
+		ADD_CASE_KEY_COMPARISON(F_UNSIGNED_INT_T, unsigned int)
+		ADD_CASE_KEY_COMPARISON(F_SIGNED_LONG_T, long)
+		ADD_CASE_KEY_COMPARISON(F_UNSIGNED_LONG_T, unsigned long)
+		ADD_CASE_KEY_COMPARISON(F_SIGNED_LONG_LONG_T, long long)
+		ADD_CASE_KEY_COMPARISON(F_UNSIGNED_LONG_LONG_T, unsigned long long)
+		ADD_CASE_KEY_COMPARISON(F_FLOAT_T, float)
+		ADD_CASE_KEY_COMPARISON(F_DOUBLE_T, double)
+		case F_STRING_T:
+			ret = strcmp(DLLST_FIELD(a, char *), DLLST_FIELD(b, char *));
+			break;
+		default:
+			ret = 0;
+			break;
+		};
+
+		if (ret)
+			return keys[k].asc ? ret : -ret;
+	}
 
-				if (next->next)
-					next->next->prev = next;
-				if (item->next)
-					item->next->prev = item;
+	return 0;
 
-				if (prenext && prenext != item)
-					prenext->next = item;
+#undef ADD_CASE_KEY_COMPARISON
+#undef DLLST_FIELD
+}
 
-				if (m == l->size - 1) {
-					item->next = NULL;
-					l->tail = item;
-				}
+/*
+ *
+ * Store at @b the bucket of the value that @field takes in @fields, that is,
+ * its distance from the smallest value declared for @field. Return FALSE if
+ * the value lies outside of the declared range.
+ *
+ */
+static boolean_t dllst_bucket(dllst_t *l, unsigned field, void *fields, unsigned long *b)
+{
+	struct f_info_st *f = l->f_info[field];
+	unsigned long long u = 0;
+	long long v = 0;
+
+#define DLLST_FIELD(f_type_p) \
+	(*((f_type_p *)fields + field * sizeof(largest_t) / sizeof(f_type_p)))
+
+	switch (f->f_type) {
+	case F_SIGNED_CHAR_T:		v = DLLST_FIELD(char); break;
+	case F_SIGNED_SHORT_T:		v = DLLST_FIELD(short); break;
+	case F_SIGNED_INT_T:		v = DLLST_FIELD(int); break;
+	case F_SIGNED_LONG_T:		v = DLLST_FIELD(long); break;
+	case F_SIGNED_LONG_LONG_T:	v = DLLST_FIELD(long long); break;
+	case F_UNSIGNED_CHAR_T:		u = DLLST_FIELD(unsigned char); goto fnunsigned;
+	case F_UNSIGNED_SHORT_T:	u = DLLST_FIELD(unsigned short); goto fnunsigned;
+	case F_UNSIGNED_INT_T:		u = DLLST_FIELD(unsigned int); goto fnunsigned;
+	case F_UNSIGNED_LONG_T:		u = DLLST_FIELD(unsigned long); goto fnunsigned;
+	case F_UNSIGNED_LONG_LONG_T:	u = DLLST_FIELD(unsigned long long); goto fnunsigned;
+	default:
+		return FALSE;
+	};
 
-#if DEBUG_DLLST_SORTROUTINE
-				debug = l->head;
-				printf("\titem |\tprev\tfields\tnext\n");
-				printf("\t-----+----------------------\n");
-				for (n=0;n<l->size;n++) {
-					printf("\t  %u  |\t", debug->n);
-
-					if (!debug->prev)
-						printf("NULL");
-					else
-						printf("%u", debug->prev->n);
-
-					dllst_sprintf(l, debug, res);
-					printf("\t%s\t", res);
-
-					if (!debug->next)
-						printf("NULL");
-					else
-						printf("%u", debug->next->n);
-
-					if (debug == preitem)
-						printf("\t<- preitem");
-					if (debug == item)
-						printf("\t<- item");
-					if (debug == prenext)
-						printf("\t<- prenext");
-					if (debug == next)
-						printf("\t<- next");
-
-					printf("\n");
-					debug = debug->next;
-				}
+	goto fnrange;
+fnunsigned:
+	// values larger than any long long are larger than f_max as well
+	if (f->f_max < 0 || u > (unsigned long long)f->f_max)
+		return FALSE;
+	v = (long long)u;
+fnrange:
+	if (v < f->f_min || v > f->f_max)
+		return FALSE;
+	*b = (unsigned long)((unsigned long long)v - (unsigned long long)f->f_min);
+	return TRUE;
+
+#undef DLLST_FIELD
+}
 
-				printf("\n --- \n");
-#endif
+/*
+ *
+ * Sort @l by @keys with a counting sort, if every key has a declared range
+ * and every item lies within them. One stable pass is made for each key,
+ * from the least significant one on, which spreads the items over a bucket
+ * for each value and links the buckets back in the order of the key, so
+ * that the list is sorted in O(nkeys * (n + DLLST_MAX_BUCKETS)) time and
+ * without comparing items. Return FALSE, leaving @l as it was, otherwise.
+ *
+ */
+static boolean_t dllst_countingsort(dllst_t *l, const dllst_sortkey_t *keys, unsigned nkeys)
+{
+	dllst_item_struct_t *head[DLLST_MAX_BUCKETS], *tail[DLLST_MAX_BUCKETS];
+	dllst_item_struct_t *list = NULL, *last = NULL, *p = NULL;
+	unsigned long nbuckets, b, n;
+	unsigned k;
+
+
+	for (k=0;k<nkeys;k++)
+		if (!l->f_info[keys[k].field]->f_ranged)
+			return FALSE;
+	for (p=l->head;p;p=p->next)
+		for (k=0;k<nkeys;k++)
+			if (!dllst_bucket(l, keys[k].field, p->fields, &b))
+				return FALSE;
+
+	list = l->head;
+	for (k=nkeys;k-->0;) {
+		nbuckets = l->f_info[keys[k].field]->f_max - l->f_info[keys[k].field]->f_min + 1;
+		memset(head, 0, nbuckets * sizeof(dllst_item_struct_t *));
+		for (p=list;p;p=p->next) {
+			dllst_bucket(l, keys[k].field, p->fields, &b);
+			if (head[b])
+				tail[b]->next = p;
+			else
+				head[b] = p;
+			tail[b] = p;
+		}
 
-			}
-			i++;
-			j = i;
+		list = NULL;
+		last = NULL;
+		for (n=0;n<nbuckets;n++) {
+			b = keys[k].asc ? n : nbuckets - 1 - n;
+			if (!head[b])
+				continue;
+			if (last)
+				last->next = head[b];
+			else
+				list = head[b];
+			last = tail[b];
 		}
+		last->next = NULL;
 	}
-}
 
-static unsigned long dllst_findmin(dllst_t *l, void *a, unsigned field, unsigned long index, boolean_t reset)
-{
-	static unsigned long min = 0UL;
-
-	static char			 var_schar = 0x7f;
-	static unsigned char		 var_uchar = ~0;
-	static short			 var_sshort = 0x7fff;
-	static unsigned short		 var_ushort = ~0;
-	static int			 var_sint = INT_MAX;
-	static unsigned int		 var_uint = UINT_MAX;
-	static long			 var_slong = LONG_MAX;
-	static unsigned long		 var_ulong = ULONG_MAX;
-	static long long		 var_slonglong = LLONG_MAX;
-	static unsigned long long	 var_ulonglong = ULLONG_MAX;
-	static float			 var_float = +3.4028234663852885981170418348451692544000e+38;
-	static double			 var_double = +1.7976931348623157081452742373170435679807e+308;
-	static char *var_string = NULL;
-
-	if (reset) {
-		var_schar = 0x7f;
-		var_uchar = ~0;
-		var_sshort = 0x7fff;
-		var_ushort = ~0;
-		var_sint = INT_MAX;
-		var_uint = UINT_MAX;
-		var_slong = LONG_MAX;
-		var_ulong = ULONG_MAX;
-		var_slonglong = LLONG_MAX;
-		var_ulonglong = ULLONG_MAX;
-		var_float = +3.4028234663852885981170418348451692544000e+38;
-		var_double = +1.7976931348623157081452742373170435679807e+308;
-		free(var_string);
-		var_string = NULL;
+	for (n=0,p=list,last=NULL;p;last=p,p=p->next,n++) {
+		p->prev = last;
+		l->index[l->first + n] = p;
 	}
+	l->head = list;
+	l->tail = last;
+	return TRUE;
+}
 
-#define ADD_CASE_STATIC_COMPARISON(f_type, f_type_p, static_var, op) \
-case f_type: \
-	if (*((f_type_p *)a + field * sizeof(largest_t) / sizeof(f_type_p)) op static_var) { \
-		static_var = *((f_type_p *)a + field * sizeof(largest_t) / sizeof(f_type_p)); \
-		min = index; \
-	} \
-	break;
+/**
+ *
+ * dllst_sortkeys() -	Order a list by several keys, each in its own direction
+ * @l:			Pointer to the list
+ * @keys:		the fields used as keys, from the most significant one
+ *			on, each with its direction (e.g., sort by x (asc), then
+ *			by y (des), and so on)
+ * @nkeys:		the number of keys at @keys
+ *
+ * The list is sorted by a bottom-up merge sort, which relinks the items where
+ * they are in O(n log n) comparisons and no extra memory, or in linear time
+ * if every key has a range declared by 'dllst_setrange'. It is stable: items
+ * which are equal by every key keep the order they had. No state is kept
+ * between calls, so different lists can be sorted at the same time, e.g.,
+ * by different threads.
+ *
+ */
+void dllst_sortkeys(dllst_t *l, const dllst_sortkey_t *keys, unsigned nkeys)
+{
+	dllst_item_struct_t *list = NULL, *tail = NULL;
+	dllst_item_struct_t *p = NULL, *q = NULL, *e = NULL;
+	unsigned long insize, nmerges, psize, qsize, n;
+
+
+	if (!l || l->size < 2 || !keys || !nkeys)
+		return;
+	if (dllst_countingsort(l, keys, nkeys))
+		return;
+
+	// merge runs of @insize items, twice as long on each pass
+	list = l->head;
+	for (insize=1;;insize*=2) {
+		p = list;
+		list = NULL;
+		tail = NULL;
+		nmerges = 0;
+
+		while (p) {
+			nmerges++;
+			q = p;
+			for (psize=0;q && psize<insize;psize++)
+				q = q->next;
+			qsize = insize;
+
+			while (psize || (qsize && q)) {
+				// on ties, the item of the first run goes first
+				if (!psize) {
+					e = q;
+					q = q->next;
+					qsize--;
+				} else if (!qsize || !q || dllst_compare(l, keys, nkeys, p->fields, q->fields) <= 0) {
+					e = p;
+					p = p->next;
+					psize--;
+				} else {
+					e = q;
+					q = q->next;
+					qsize--;
+				}
 
-	switch (l->f_info[field]->f_type) {
-	ADD_CASE_STATIC_COMPARISON(F_SIGNED_CHAR_T, char, var_schar, <=)
-	ADD_CASE_STATIC_COMPARISON(F_UNSIGNED_CHAR_T, unsigned char, var_uchar, <=)
-	ADD_CASE_STATIC_COMPARISON(F_SIGNED_SHORT_T, short, var_sshort, <=)
-	ADD_CASE_STATIC_COMPARISON(F_UNSIGNED_SHORT_T, unsigned short, var_ushort, <=)
-	ADD_CASE_STATIC_COMPARISON(F_SIGNED_INT_T, int, var_sint, <=)
-	ADD_CASE_STATIC_COMPARISON(F_UNSIGNED_INT_T, unsigned int, var_uint, <=)
-	ADD_CASE_STATIC_COMPARISON(F_SIGNED_LONG_T, long, var_slong, <=)
-	ADD_CASE_STATIC_COMPARISON(F_UNSIGNED_LONG_T, unsigned long, var_ulong, <=)
-	ADD_CASE_STATIC_COMPARISON(F_SIGNED_LONG_LONG_T, long long, var_slonglong, <=)
-	ADD_CASE_STATIC_COMPARISON(F_UNSIGNED_LONG_LONG_T, unsigned long long, var_ulonglong, <=)
-	ADD_CASE_STATIC_COMPARISON(F_FLOAT_T, float, var_float, <)
-	ADD_CASE_STATIC_COMPARISON(F_DOUBLE_T, double, var_double, <)
-	case F_STRING_T:
-		if (!var_string) {
-new_string:
-			var_string = (char *)calloc(1, \
-					strlen(*((char **)a + field * sizeof(largest_t) / sizeof(char *))) + 1);
-			strcpy(var_string, *((char **)a + field * sizeof(largest_t) / sizeof(char *)));
-			min = index;
-		} else {
-			if (strcmp(*((char **)a + field * sizeof(largest_t) / sizeof(char *)), var_string) <= 0) {
-				free(var_string);
-				goto new_string;
+				if (tail)
+					tail->next = e;
+				else
+					list = e;
+				tail = e;
 			}
+			p = q;
 		}
-		break;
-	};
+		tail->next = NULL;
 
-	return min;
+		if (nmerges <= 1)
+			break;
+	}
 
-#undef ADD_CASE_STATIC_COMPARISON
+	// backward links and the index are set in a single pass at the end
+	for (n=0,p=list,q=NULL;p;q=p,p=p->next,n++) {
+		p->prev = q;
+		l->index[l->first + n] = p;
+	}
+	l->head = list;
+	l->tail = q;
 }
 
-static unsigned long dllst_findmax(dllst_t *l, void *a, unsigned field, unsigned long index, boolean_t reset)
+/**
+ *
+ * dllst_sortby() -	Order a list by specified key and direction
+ * @l:			Pointer to the list
+ * @field:		the field used as a key
+ * @asc:		set to TRUE if ascending order is desired,
+ *			FALSE otherwise
+ *
+ * Same as 'dllst_sortkeys' with a single key.
+ *
+ */
+void dllst_sortby(dllst_t *l, unsigned field, boolean_t asc)
 {
-	static unsigned long max = 0UL;
-
-	static char			 var_schar = 0x80;
-	static unsigned char		 var_uchar = 0;
-	static short			 var_sshort = 0x8000;
-	static unsigned short		 var_ushort = 0;
-	static int			 var_sint = INT_MIN;
-	static unsigned int		 var_uint = 0;
-	static long			 var_slong = LONG_MIN;
-	static unsigned long		 var_ulong = 0UL;
-	static long long		 var_slonglong = LLONG_MIN;
-	static unsigned long long	 var_ulonglong = 0ULL;
-	static float			 var_float = -3.4028234663852885981170418348451692544000e+38;
-	static double			 var_double = -1.7976931348623157081452742373170435679807e+308;
-	static char *var_string = NULL;
-
-	if (reset) {
-		var_schar = 0x80;
-		var_uchar = 0;
-		var_sshort = 0x8000;
-		var_ushort = 0;
-		var_sint = INT_MIN;
-		var_uint = 0;
-		var_slong = LONG_MIN;
-		var_ulong = 0UL;
-		var_slonglong = LLONG_MIN;
-		var_ulonglong = 0ULL;
-		var_float = -3.4028234663852885981170418348451692544000e+38;
-		var_double = -1.7976931348623157081452742373170435679807e+308;
-		free(var_string);
-		var_string = NULL;
-	}
+	dllst_sortkey_t key = { field, asc };
 
-#define ADD_CASE_STATIC_COMPARISON(f_type, f_type_p, static_var, op) \
-case f_type: \
-	if (*((f_type_p *)a + field * sizeof(largest_t) / sizeof(f_type_p)) op static_var) { \
-		static_var = *((f_type_p *)a + field * sizeof(largest_t) / sizeof(f_type_p)); \
-		max = index; \
-	} \
-	break;
 
-	switch (l->f_info[field]->f_type) {
-	ADD_CASE_STATIC_COMPARISON(F_SIGNED_CHAR_T, char, var_schar, >=)
-	ADD_CASE_STATIC_COMPARISON(F_UNSIGNED_CHAR_T, unsigned char, var_uchar, >=)
-	ADD_CASE_STATIC_COMPARISON(F_SIGNED_SHORT_T, short, var_sshort, >=)
-	ADD_CASE_STATIC_COMPARISON(F_UNSIGNED_SHORT_T, unsigned short, var_ushort, >=)
-	ADD_CASE_STATIC_COMPARISON(F_SIGNED_INT_T, int, var_sint, >=)
-	ADD_CASE_STATIC_COMPARISON(F_UNSIGNED_INT_T, unsigned int, var_uint, >=)
-	ADD_CASE_STATIC_COMPARISON(F_SIGNED_LONG_T, long, var_slong, >=)
-	ADD_CASE_STATIC_COMPARISON(F_UNSIGNED_LONG_T, unsigned long, var_ulong, >=)
-	ADD_CASE_STATIC_COMPARISON(F_SIGNED_LONG_LONG_T, long long, var_slonglong, >=)
-	ADD_CASE_STATIC_COMPARISON(F_UNSIGNED_LONG_LONG_T, unsigned long long, var_ulonglong, >=)
-	ADD_CASE_STATIC_COMPARISON(F_FLOAT_T, float, var_float, >)
-	ADD_CASE_STATIC_COMPARISON(F_DOUBLE_T, double, var_double, >)
-	case F_STRING_T:
-		if (!var_string) {
-new_string:
-			var_string = (char *)calloc(1, \
-					strlen(*((char **)a + field * sizeof(largest_t) / sizeof(char *))) + 1);
-			strcpy(var_string, *((char **)a + field * sizeof(largest_t) / sizeof(char *)));
-			max = index;
-		} else {
-			if (strcmp(*((char **)a + field * sizeof(largest_t) / sizeof(char *)), var_string) >= 0) {
-				free(var_string);
-				goto new_string;
-			}
-		}
-		break;
-	};
-
-	return max;
-
-#undef ADD_CASE_STATIC_COMPARISON
+	dllst_sortkeys(l, &key, 1);
 }
-
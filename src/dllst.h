@@ -20,6 +20,7 @@
  */
 #ifndef _DLLST_H_
 #define _DLLST_H_
+#include <stddef.h>
 #ifndef _HAVE_BOOLEAN_T_
 #define _HAVE_BOOLEAN_T_
 typedef enum { FALSE=0, TRUE } boolean_t;
@@ -44,13 +45,16 @@ typedef struct f_info_st {
 	field_type_t f_type;
 	unsigned f_size;
 	char *f_sprintf;
+	boolean_t f_ranged;	// Whether f_min and f_max were set by 'dllst_setrange'
+	long long f_min;
+	long long f_max;
 } f_info_t;
 #endif
 
 typedef struct dllst_item_struct {
-	void *fields;
 	struct dllst_item_struct *prev;
 	struct dllst_item_struct *next;
+	unsigned char fields[] __attribute__((aligned(sizeof(long long))));	// Inline, right after the links
 } dllst_item_struct_t;
 
 typedef struct dllst_struct {
@@ -59,15 +63,28 @@ typedef struct dllst_struct {
 	unsigned long size;
 	dllst_item_struct_t *head;
 	dllst_item_struct_t *tail;
+	size_t recsize;			// Bytes of the fields of each item
+	dllst_item_struct_t **index;	// Items by position, the first one at index[first]
+	unsigned long first;
+	unsigned long capacity;		// Entries allocated in index
 } dllst_t;
 
+typedef struct dllst_sortkey_st {
+	unsigned field;
+	boolean_t asc;
+} dllst_sortkey_t;
+
 extern boolean_t dllst_verbose;
 
 extern dllst_t *dllst_initlst (dllst_t *l, char *fields_info);
+extern int dllst_setrange (dllst_t *l, unsigned int field, long long min, long long max);
 extern dllst_item_struct_t *dllst_newitem (dllst_t *l, void *fields);
 extern dllst_item_struct_t *dllst_getitem(dllst_t *l, unsigned long n);
 extern dllst_item_struct_t *dllst_delitem (dllst_t *l, long unsigned int n);
 extern boolean_t dllst_isinlst (dllst_t *l, void *fields);
 extern void dllst_swapitems(dllst_t *l, unsigned long a, unsigned long b);
+extern void dllst_sortkeys (dllst_t *l, const dllst_sortkey_t *keys, unsigned nkeys);
 extern void dllst_sortby (dllst_t *l, unsigned int field, boolean_t asc);
+extern void dllst_clear (dllst_t *l);
+extern void dllst_releasepool (void);
 #endif
@@ -22,158 +22,443 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <X11/Xlib.h>
-#include <X11/Xutil.h>
 #include "gui.h"
 
 /*
  *
- * Create a new dialog on the X display @display and X window @window, with the
- * specified title, x, y, width and height and then display it.
+ * Return TRUE if the widget @w overlaps the rectangle from (@x0, @y0) to
+ * (@x1, @y1), FALSE otherwise.
+ *
+ */
+static boolean_t gui_overlaps(gui_widget_t *w, int x0, int y0, int x1, int y1)
+{
+	return w->x0 < x1 && x0 < w->x1 && w->y0 < y1 && y0 < w->y1;
+}
+
+/*
+ *
+ * Create a new widget of type @type inside of the dialog @dlg and append it
+ * to the list of its children. Geometry and contents are set by the caller.
+ * Return the new widget or NULL if it could not be allocated.
+ *
+ */
+static gui_widget_t *gui_newwidget(gui_dialog_t *dlg, gui_widget_type_t type)
+{
+	gui_widget_t *w = NULL;
+
+
+	w = (gui_widget_t *)calloc(1, sizeof(gui_widget_t));
+	if (w) {
+		w->type = type;
+		if (dlg->last)
+			dlg->last->next = w;
+		else
+			dlg->widgets = w;
+		dlg->last = w;
+	}
+
+	return w;
+}
+
+/*
+ *
+ * Register the button @w in every cell of the hit-testing grid of @dlg that
+ * it overlaps, so that a click only has to look at the few buttons sharing
+ * the cell below the pointer.
+ * Return TRUE on success, FALSE if some cell could not grow, in which case
+ * @w is left out of every cell.
+ *
+ */
+static boolean_t gui_index(gui_dialog_t *dlg, gui_widget_t *w)
+{
+	int cx, cy, cx0, cy0, cx1, cy1;
+	gui_cell_t *cell;
+	gui_widget_t **items;
+
+
+	cx0 = (w->x0 - dlg->x0) / GUI_CELL_SIZE;
+	cy0 = (w->y0 - dlg->y0) / GUI_CELL_SIZE;
+	cx1 = (w->x1 - 1 - dlg->x0) / GUI_CELL_SIZE;
+	cy1 = (w->y1 - 1 - dlg->y0) / GUI_CELL_SIZE;
+	if (cx0 < 0)
+		cx0 = 0;
+	if (cy0 < 0)
+		cy0 = 0;
+	if (cx1 >= (int)dlg->gridw)
+		cx1 = dlg->gridw - 1;
+	if (cy1 >= (int)dlg->gridh)
+		cy1 = dlg->gridh - 1;
+
+	for (cy=cy0;cy<=cy1;cy++) {
+		for (cx=cx0;cx<=cx1;cx++) {
+			cell = &dlg->grid[cy * dlg->gridw + cx];
+			items = (gui_widget_t **)realloc(cell->items, (cell->nitems + 1) * sizeof(gui_widget_t *));
+			if (!items)
+				goto fnundo;
+			items[cell->nitems++] = w;
+			cell->items = items;
+		}
+	}
+
+	return TRUE;
+
+fnundo:
+	// @w is the last item of every cell it was added to so far
+	while (cx-- > cx0)
+		dlg->grid[cy * dlg->gridw + cx].nitems--;
+	while (cy-- > cy0)
+		for (cx=cx0;cx<=cx1;cx++)
+			dlg->grid[cy * dlg->gridw + cx].nitems--;
+	return FALSE;
+}
+
+/*
+ *
+ * Draw the background and the title bar of the dialog @dlg, but only where
+ * it was invalidated.
+ *
+ */
+static void gui_draw_dialog(gui_dialog_t *dlg)
+{
+	render_fill(dlg->layer, 0x003030, dlg->dirty_x0 - dlg->x0, dlg->dirty_y0 - dlg->y0,
+		    dlg->dirty_x1 - dlg->dirty_x0, dlg->dirty_y1 - dlg->dirty_y0);
+
+	if (dlg->dirty_y0 < dlg->y0 + 18) {
+		render_fill(dlg->layer, 0x002020, 2, 2, dlg->x1 - dlg->x0 - 4, 16);
+		render_text(dlg->layer, 0xffffff, 0x002020, 10, 14, dlg->title, strlen(dlg->title));
+	}
+}
+
+/*
+ *
+ * Draw the label @w of the dialog @dlg.
+ *
+ */
+static void gui_draw_label(gui_dialog_t *dlg, gui_widget_t *w)
+{
+	render_text(dlg->layer, 0xaaaaaa, 0x003030, w->x0 - dlg->x0, w->y1 - 3 - dlg->y0,
+		    w->text, strlen(w->text));
+}
+
+/*
+ *
+ * Draw the button @w of the dialog @dlg.
+ *
+ */
+static void gui_draw_button(gui_dialog_t *dlg, gui_widget_t *w)
+{
+	render_fill(dlg->layer, 0x005050, w->x0 - dlg->x0, w->y0 - dlg->y0, w->x1 - w->x0, w->y1 - w->y0);
+	render_text(dlg->layer, 0xcccccc, 0x005050, w->x0 - dlg->x0 + FNT_WIDTH, w->y0 - dlg->y0 + FNT_HEIGHT,
+		    w->text, strlen(w->text));
+}
+
+/*
+ *
+ * Render the table @tab and its contents. Also, it applies different styles
+ * to even and odd rows.
+ *
+ */
+static void gui_draw_table(gui_table_t *tab)
+{
+	int i, j, x, y;
+	unsigned goffset, color;
+	char *text;
+
+
+	x = tab->widget->x0 - tab->dlg->x0;
+	y = tab->widget->y0 - tab->dlg->y0;
+	for (i=0;i<tab->nrows;i++) {
+		color = i & 1 ? 0x005050 : 0x004040;
+		for (j=0,goffset=0;j<tab->row[i].ncols;j++) {
+			render_fill(tab->dlg->layer, color, x + goffset, y, tab->row[i].col[j].width, tab->row[i].height);
+			text = tab->row[i].col[j].text ? tab->row[i].col[j].text : "";
+			render_text(tab->dlg->layer, 0xcccccc, color, x + goffset + FNT_WIDTH, y + FNT_HEIGHT,
+				    text, strlen(text));
+			goffset += tab->row[i].col[j].width;
+		}
+		y += tab->row[i].height;
+	}
+}
+
+/*
+ *
+ * Create a new dialog shown on top of the frame @frame, with the specified
+ * title, x, y, width and height. The dialog and every widget added to it
+ * later are kept in memory and drawn on its own layer of the frame on the
+ * next call to gui_update(); only one dialog can be shown at a time.
  * Return the recently created dialog or NULL if it could not make room to
  * hold the corresponding structure.
  *
  */
-gui_dialog_t *gui_newdialog(Display *display, Window window, char *title, int x, int y, int width, int height)
+gui_dialog_t *gui_newdialog(render_frame_t *frame, char *title, int x, int y, int width, int height)
 {
 	gui_dialog_t *dialog = NULL;
-	GC gc_gui_background, gc_gui_titlebar_bg, gc_gui_titlebar_fg;
-
 
-	gc_gui_background  = XCreateGC(display, window, 0, NULL);
-	gc_gui_titlebar_bg = XCreateGC(display, window, 0, NULL);
-	gc_gui_titlebar_fg = XCreateGC(display, window, 0, NULL);
-	XSetForeground(display, gc_gui_background,  0x003030);
-	XSetForeground(display, gc_gui_titlebar_bg, 0x002020);
-	XSetForeground(display, gc_gui_titlebar_fg, 0xffffff);
-	XSetBackground(display, gc_gui_titlebar_fg, 0x002020);
 
 	dialog = (gui_dialog_t *)calloc(1, sizeof(gui_dialog_t));
 	if (dialog) {
-		dialog->dy = display;
-		dialog->win = window;
+		dialog->frame = frame;
 		dialog->x0 = x;
 		dialog->y0 = y;
 		dialog->x1 = x + width;
 		dialog->y1 = y + height;
-		dialog->rect = XCreatePixmap(display, window, width, height, XDefaultScreenOfDisplay(display)->root_depth);
-		XCopyArea(display, window, dialog->rect, gc_gui_background, x, y, width, height, 0, 0);
-		XFillRectangle(display, window, gc_gui_background, x, y, width, height);
-		XFillRectangle(display, window, gc_gui_titlebar_bg, x + 2, y + 2, width - 4, 16);
-		XDrawImageString(display, window, gc_gui_titlebar_fg, x + 10, y + 14, title, strlen(title));
+		dialog->gridw = (width + GUI_CELL_SIZE - 1) / GUI_CELL_SIZE;
+		dialog->gridh = (height + GUI_CELL_SIZE - 1) / GUI_CELL_SIZE;
+		dialog->grid = (gui_cell_t *)calloc(dialog->gridw * dialog->gridh, sizeof(gui_cell_t));
+		dialog->title = (char *)calloc(1, strlen(title) + 1);
+		dialog->layer = render_newlayer(frame, width, height);
+		if (!dialog->grid || !dialog->title || !dialog->layer) {
+			render_destroyframe(dialog->layer);
+			free(dialog->grid);
+			free(dialog->title);
+			free(dialog);
+			return NULL;
+		}
+		strcpy(dialog->title, title);
+		render_overlay(frame, dialog->layer, x, y);
+		gui_invalidate(dialog, x, y, width, height);
 	}
 
-	XFreeGC(display, gc_gui_background);
-	XFreeGC(display, gc_gui_titlebar_bg);
-	XFreeGC(display, gc_gui_titlebar_fg);
-
 	return dialog;
 }
 
 /*
  *
- * Free allocated bytes from a previously initialized dialog @dlg. Also, the original
- * contents of the lower window are restored and shown.
+ * Free allocated bytes from a previously initialized dialog @dlg, including
+ * all of its widgets. The frame below displays what was hidden by the dialog
+ * again on its next flush.
  *
  */
 void gui_destroydialog(gui_dialog_t *dlg)
 {
-	GC gc;
+	gui_widget_t *w, *next;
+	unsigned i;
 
 
 	if (!dlg)
 		return;
 
-	gc = XCreateGC(dlg->dy, dlg->win, 0, NULL);
-	XSetForeground(dlg->dy, gc, 0x000000);
-	XCopyArea(dlg->dy, dlg->rect, dlg->win, gc,
-		  0, 0, dlg->x1 - dlg->x0, dlg->y1 - dlg->y0, dlg->x0, dlg->y0);
-	XFreePixmap(dlg->dy, dlg->rect);
-	XFreeGC(dlg->dy, gc);
+	for (w=dlg->widgets;w;w=next) {
+		next = w->next;
+		if (w->table) {
+			for (i=0;i<w->table->nrows;i++) {
+				while (w->table->row[i].ncols)
+					free(w->table->row[i].col[--w->table->row[i].ncols].text);
+				free(w->table->row[i].col);
+			}
+			free(w->table->row);
+			free(w->table);
+		}
+		free(w->text);
+		free(w);
+	}
+	render_overlay(dlg->frame, NULL, 0, 0);
+	render_destroyframe(dlg->layer);
+	for (i=0;i<dlg->gridw*dlg->gridh;i++)
+		free(dlg->grid[i].items);
+	free(dlg->grid);
+	free(dlg->title);
 	free(dlg);
 	dlg = NULL;
 }
 
+/*
+ *
+ * Mark the rectangle (@x, @y, @w, @h) of the window as needing to be redrawn
+ * by the next call to gui_update() on the dialog @dlg, e.g., after some of its
+ * widgets changed. Parts of the rectangle out of the dialog are ignored.
+ *
+ */
+void gui_invalidate(gui_dialog_t *dlg, int x, int y, unsigned w, unsigned h)
+{
+	int x1 = x + w, y1 = y + h;
+
+
+	if (!dlg)
+		return;
+
+	if (x < dlg->x0)
+		x = dlg->x0;
+	if (y < dlg->y0)
+		y = dlg->y0;
+	if (x1 > dlg->x1)
+		x1 = dlg->x1;
+	if (y1 > dlg->y1)
+		y1 = dlg->y1;
+	if (x >= x1 || y >= y1)
+		return;
+
+	if (dlg->dirty_x0 >= dlg->dirty_x1 || dlg->dirty_y0 >= dlg->dirty_y1) {
+		dlg->dirty_x0 = x;
+		dlg->dirty_y0 = y;
+		dlg->dirty_x1 = x1;
+		dlg->dirty_y1 = y1;
+	} else {
+		if (x < dlg->dirty_x0)
+			dlg->dirty_x0 = x;
+		if (y < dlg->dirty_y0)
+			dlg->dirty_y0 = y;
+		if (x1 > dlg->dirty_x1)
+			dlg->dirty_x1 = x1;
+		if (y1 > dlg->dirty_y1)
+			dlg->dirty_y1 = y1;
+	}
+}
+
+/*
+ *
+ * Redraw the invalidated area of the dialog @dlg: its background is painted
+ * again and only the widgets which overlap that area are drawn on top. What
+ * changed is sent by the next flush of the frame of the dialog.
+ *
+ */
+void gui_update(gui_dialog_t *dlg)
+{
+	gui_widget_t *w;
+
+
+	if (!dlg || dlg->dirty_x0 >= dlg->dirty_x1 || dlg->dirty_y0 >= dlg->dirty_y1)
+		return;
+
+	gui_draw_dialog(dlg);
+	for (w=dlg->widgets;w;w=w->next) {
+		if (!gui_overlaps(w, dlg->dirty_x0, dlg->dirty_y0, dlg->dirty_x1, dlg->dirty_y1))
+			continue;
+
+		switch (w->type) {
+		case GUI_LABEL:
+			gui_draw_label(dlg, w);
+			break;
+		case GUI_BUTTON:
+			gui_draw_button(dlg, w);
+			break;
+		case GUI_TABLE:
+			gui_draw_table(w->table);
+			break;
+		}
+	}
+	dlg->dirty_x0 = dlg->dirty_x1 = 0;
+	dlg->dirty_y0 = dlg->dirty_y1 = 0;
+}
+
 /*
  *
  * Add text @label to the dialog @dlg at the specified row.
  * By default, each label starts to be shown at the left margin of the dialog.
+ * Since the font has a fixed width, text which would not fit in the dialog is
+ * cut here rather than by clipping on the server side.
  *
  */
 void gui_addlabel(gui_dialog_t *dlg, char *label, unsigned row)
 {
-	GC gc_gui_label;
-	XRectangle rects;
+	int y, len, maxlen;
+	gui_widget_t *w;
 
 
 	if (!dlg)
 		return;
 
-	gc_gui_label = XCreateGC(dlg->dy, dlg->win, 0, NULL);
-	XSetForeground(dlg->dy, gc_gui_label, 0xaaaaaa);
-	XSetBackground(dlg->dy, gc_gui_label, 0x003030);
-
-	rects.x = dlg->x0;
-	rects.y = dlg->y0;
-	rects.width = dlg->x1 - dlg->x0;
-	rects.height = dlg->y1 - dlg->y0;
-	XSetClipRectangles(dlg->dy, gc_gui_label, 0, 0, &rects, 1, YXBanded);
+	y = dlg->y0 + 30 + row * (FNT_HEIGHT + 1);
+	if (y > dlg->y1)
+		return;
 
-	XDrawImageString(dlg->dy, dlg->win, gc_gui_label,
-			 dlg->x0 + 10, dlg->y0 + 30 + row * (FNT_HEIGHT + 1),
-			 label, strlen(label));
+	len = strlen(label);
+	maxlen = (dlg->x1 - dlg->x0 - 10) / FNT_WIDTH;
+	if (len > maxlen)
+		len = maxlen;
 
-	XFreeGC(dlg->dy, gc_gui_label);
+	w = gui_newwidget(dlg, GUI_LABEL);
+	if (!w)
+		return;
+	w->text = (char *)calloc(1, len + 1);
+	if (w->text)
+		strncpy(w->text, label, len);
+	else
+		len = 0;
+	w->x0 = dlg->x0 + 10;
+	w->y0 = y - FNT_HEIGHT + 3;
+	w->x1 = w->x0 + len * FNT_WIDTH;
+	w->y1 = y + 3;
+	gui_invalidate(dlg, w->x0, w->y0, w->x1 - w->x0, w->y1 - w->y0);
 }
 
 /*
  *
  * Add a button to the dialog @dlg, with the text @caption, at specified
  * x and y offsets from the left and top margins of the dialog, respectively.
- * Return the button recently created or NULL if it could not be allocated.
+ * @id is stored in the button so that its owner can tell which one was
+ * clicked when gui_hittest() returns it.
+ * Return the button recently created or NULL if it could not be allocated,
+ * in which case the dialog is left as it was.
  *
  */
-gui_button_t *gui_addbutton(gui_dialog_t *dlg, char *caption, int dx, int dy)
+gui_button_t *gui_addbutton(gui_dialog_t *dlg, char *caption, int dx, int dy, int id)
 {
-	GC gc_gui_button_bg;
-	GC gc_gui_foreground;
 	gui_button_t *button = NULL;
+	gui_widget_t *last;
 
 
 	if (!dlg)
 		return NULL;
 
-	gc_gui_button_bg  = XCreateGC(dlg->dy, dlg->win, 0, NULL);
-	gc_gui_foreground = XCreateGC(dlg->dy, dlg->win, 0, NULL);
-	XSetForeground(dlg->dy, gc_gui_button_bg,  0x005050);
-	XSetForeground(dlg->dy, gc_gui_foreground, 0xcccccc);
-	XSetBackground(dlg->dy, gc_gui_foreground, 0x005050);
-
-	button = (gui_button_t *)calloc(1, sizeof(gui_button_t));
+	last = dlg->last;
+	button = gui_newwidget(dlg, GUI_BUTTON);
 	if (button) {
+		button->id = id;
+		button->text = (char *)calloc(1, strlen(caption) + 1);
+		if (button->text)
+			strcpy(button->text, caption);
 		button->x0 = dlg->x0 + 2 + dx;
 		button->y0 = dlg->y0 + 16 + dy;
 		button->x1 = button->x0 + (strlen(caption) + 2) * FNT_WIDTH;
 		button->y1 = button->y0 + 20;
-		XFillRectangle(dlg->dy, dlg->win, gc_gui_button_bg,
-			       button->x0, button->y0, (strlen(caption) + 2) * FNT_WIDTH, 20);
-		XDrawImageString(dlg->dy, dlg->win, gc_gui_foreground,
-				 dlg->x0 + 2 + dx + FNT_WIDTH,
-				 dlg->y0 + 16 + dy + FNT_HEIGHT, caption, strlen(caption));
+		if (!button->text || !gui_index(dlg, button)) {
+			if (last)
+				last->next = NULL;
+			else
+				dlg->widgets = NULL;
+			dlg->last = last;
+			free(button->text);
+			free(button);
+			return NULL;
+		}
+		gui_invalidate(dlg, button->x0, button->y0, button->x1 - button->x0, button->y1 - button->y0);
 	}
 
-	XFreeGC(dlg->dy, gc_gui_button_bg);
-	XFreeGC(dlg->dy, gc_gui_foreground);
-
 	return button;
 }
 
+/*
+ *
+ * Return the button of the dialog @dlg which lies below the point (@x, @y)
+ * of the window, or NULL if there is none. Only the buttons registered in
+ * the cell of the grid containing the point are tested.
+ *
+ */
+gui_button_t *gui_hittest(gui_dialog_t *dlg, int x, int y)
+{
+	gui_cell_t *cell;
+	unsigned i;
+
+
+	if (!dlg || x < dlg->x0 || x >= dlg->x1 || y < dlg->y0 || y >= dlg->y1)
+		return NULL;
+
+	cell = &dlg->grid[((y - dlg->y0) / GUI_CELL_SIZE) * dlg->gridw + (x - dlg->x0) / GUI_CELL_SIZE];
+	for (i=0;i<cell->nitems;i++)
+		if (gui_overlaps(cell->items[i], x, y, x + 1, y + 1))
+			return cell->items[i];
+
+	return NULL;
+}
+
 /*
  *
  * Create a table of @nrows rows per @ncols columns on the dialog @dlg.
  * This function only allocates and initializes the appropriate structure members:
  * to set each cell of the table and display it use gui_table_cell_set() and
- * gui_table_show(), respectively.
+ * gui_table_show(), respectively. The table belongs to the dialog and is freed
+ * along with it.
  * Return the table recently created or NULL if it could not be allocated.
  *
  */
@@ -188,8 +473,6 @@ gui_table_t *gui_table_new(gui_dialog_t *dlg, unsigned nrows, unsigned ncols)
 
 	tab = (gui_table_t *)calloc(1, sizeof(gui_table_t));
 	if (tab) {
-		tab->dy = dlg->dy;
-		tab->win = dlg->win;
 		tab->dlg = dlg;
 		tab->nrows = nrows;
 		tab->row = (gui_table_row_t *)calloc(nrows, sizeof(gui_table_row_t));
@@ -198,12 +481,18 @@ gui_table_t *gui_table_new(gui_dialog_t *dlg, unsigned nrows, unsigned ncols)
 				tab->row[i].ncols = ncols;
 				tab->row[i].col = (gui_table_col_t *)calloc(ncols, sizeof(gui_table_col_t));
 			}
-		} else {
+		}
+		if (tab->row)
+			tab->widget = gui_newwidget(dlg, GUI_TABLE);
+		if (!tab->row || !tab->widget) {
+			if (tab->row)
+				for (i=0;i<nrows;i++)
+					free(tab->row[i].col);
 			free(tab->row);
 			free(tab);
+			return NULL;
 		}
-	} else {
-		free(tab);
+		tab->widget->table = tab;
 	}
 
 	return tab;
@@ -241,6 +530,8 @@ boolean_t gui_table_cell_set(gui_table_t *tab, unsigned row, unsigned col, char
 					tab->row[i].col[col].width = (strlen(text) + 2) * FNT_WIDTH;
 			}
 			tab->row[row].height = FNT_HEIGHT + 8;
+			gui_invalidate(tab->dlg, tab->widget->x0, tab->widget->y0,
+				       tab->widget->x1 - tab->widget->x0, tab->widget->y1 - tab->widget->y0);
 
 			ret = TRUE;
 		} else {
@@ -255,51 +546,31 @@ boolean_t gui_table_cell_set(gui_table_t *tab, unsigned row, unsigned col, char
 
 /*
  *
- * Render the table @tab and its contents at specified x and y offsets from
- * the left and top margins of the dialog this table was added in. Also, it
- * applies different styles to even and odd rows.
+ * Place the table @tab at specified x and y offsets from the left and top
+ * margins of the dialog this table was added in. It is drawn, like the rest
+ * of the dialog, by the next call to gui_update(), with different styles for
+ * even and odd rows.
  *
  */
 void gui_table_show(gui_table_t *tab, unsigned dx, unsigned dy)
 {
-	int i, j, t, x, y, w, h;
-	unsigned goffset = 0;
-	char *label = NULL;
-	GC gc, gc_gui_table_row_even, gc_gui_table_row_odd, gc_gui_table_cell;
+	gui_widget_t *w;
+	unsigned i, width = 0, height = 0;
 
 
 	if (!tab)
 		return;
 
-	gc_gui_table_row_even = XCreateGC(tab->dy, tab->win, 0, NULL);
-	gc_gui_table_row_odd = XCreateGC(tab->dy, tab->win, 0, NULL);
-	gc_gui_table_cell = XCreateGC(tab->dy, tab->win, 0, NULL);
-	XSetForeground(tab->dy, gc_gui_table_row_even, 0x004040);
-	XSetForeground(tab->dy, gc_gui_table_row_odd,  0x005050);
-	XSetForeground(tab->dy, gc_gui_table_cell, 0xcccccc);
-
-	for (i=0;i<tab->nrows;i++) {
-		for (j=0;j<tab->row[i].ncols;j++) {
-			goffset = 0;
-
-			for (t=0;t<j;t++)
-				goffset += tab->row[i].col[t].width;
-
-			x = tab->dlg->x0 + dx + goffset;
-			y = tab->dlg->y0 + 16 + dy + i * tab->row[i].height;
-			w = tab->row[i].col[j].width;
-			h = tab->row[i].height;
-			label = tab->row[i].col[j].text;
-			gc = i & 1 ? gc_gui_table_row_odd : gc_gui_table_row_even;
-			XSetBackground(tab->dy, gc_gui_table_cell, i & 1 ? 0x005050 : 0x004040);
-			XFillRectangle(tab->dy, tab->win, gc, x, y, w, h);
-			XDrawImageString(tab->dy, tab->win, gc_gui_table_cell,
-					 x + FNT_WIDTH, y + FNT_HEIGHT, label, strlen(label));
-		}
-	}
-
-	XFreeGC(tab->dy, gc_gui_table_row_even);
-	XFreeGC(tab->dy, gc_gui_table_row_odd);
-	XFreeGC(tab->dy, gc_gui_table_cell);
+	for (i=0;tab->nrows && i<tab->row[0].ncols;i++)
+		width += tab->row[0].col[i].width;
+	for (i=0;i<tab->nrows;i++)
+		height += tab->row[i].height;
+
+	w = tab->widget;
+	gui_invalidate(tab->dlg, w->x0, w->y0, w->x1 - w->x0, w->y1 - w->y0);
+	w->x0 = tab->dlg->x0 + dx;
+	w->y0 = tab->dlg->y0 + 16 + dy;
+	w->x1 = w->x0 + width;
+	w->y1 = w->y0 + height;
+	gui_invalidate(tab->dlg, w->x0, w->y0, width, height);
 }
-
@@ -24,27 +24,58 @@
 #define _HAVE_BOOLEAN_T_
 typedef enum { FALSE=0, TRUE } boolean_t;
 #endif
-#include <X11/Xlib.h>
+#include "render.h"
 
 #define FNT_WIDTH               6
 #define FNT_HEIGHT              13
 
-typedef struct gui_dialog_st {
-	Display *dy;
-	Window win;
-	int x0;
+#define GUI_CELL_SIZE		32	// Side of the cells of the hit-testing grid
+
+typedef enum {
+	GUI_LABEL=0,
+	GUI_BUTTON,
+	GUI_TABLE
+} gui_widget_type_t;
+
+struct gui_table_st;
+
+typedef struct gui_widget_st {
+	gui_widget_type_t type;
+	int x0;				// Bounding box in window coordinates
 	int y0;
 	int x1;
 	int y1;
-	Pixmap rect;
-} gui_dialog_t;
+	int id;				// Identifier of a button given by its owner
+	char *text;			// Text of a label or caption of a button
+	struct gui_table_st *table;
+	struct gui_widget_st *next;
+} gui_widget_t;
+
+typedef gui_widget_t gui_button_t;
+
+typedef struct gui_cell_st {
+	unsigned nitems;
+	gui_widget_t **items;
+} gui_cell_t;
 
-typedef struct gui_button_st {
+typedef struct gui_dialog_st {
+	render_frame_t *frame;		// Frame the dialog is shown on
+	render_frame_t *layer;		// Where the dialog is drawn
 	int x0;
 	int y0;
 	int x1;
 	int y1;
-} gui_button_t;
+	char *title;
+	gui_widget_t *widgets;		// Children in the order they were added
+	gui_widget_t *last;
+	gui_cell_t *grid;		// Buttons which overlap each cell of the dialog
+	unsigned gridw;
+	unsigned gridh;
+	int dirty_x0;			// Area to be redrawn by the next gui_update()
+	int dirty_y0;
+	int dirty_x1;
+	int dirty_y1;
+} gui_dialog_t;
                                                                                             
 typedef struct gui_table_col_st {
         unsigned width;
@@ -58,17 +89,19 @@ typedef struct gui_table_row_st {
 } gui_table_row_t;
 
 typedef struct gui_table_st {
-        Display *dy;
-        Window win;
         gui_dialog_t *dlg;
+        gui_widget_t *widget;
         unsigned nrows;
         gui_table_row_t *row;
 } gui_table_t;
 
-extern gui_dialog_t *gui_newdialog(Display *dy, Window win, char *title, int x, int y, int w, int h);
+extern gui_dialog_t *gui_newdialog(render_frame_t *frame, char *title, int x, int y, int w, int h);
 extern void gui_destroydialog(gui_dialog_t *dlg);
 extern void gui_addlabel(gui_dialog_t *dlg, char *label, unsigned row);
-extern gui_button_t *gui_addbutton(gui_dialog_t *dlg, char *caption, int dx, int dy);
+extern gui_button_t *gui_addbutton(gui_dialog_t *dlg, char *caption, int dx, int dy, int id);
+extern gui_button_t *gui_hittest(gui_dialog_t *dlg, int x, int y);
+extern void gui_invalidate(gui_dialog_t *dlg, int x, int y, unsigned w, unsigned h);
+extern void gui_update(gui_dialog_t *dlg);
 extern gui_table_t *gui_table_new(gui_dialog_t *dlg, unsigned nrows, unsigned ncols);
 extern boolean_t gui_table_cell_set(gui_table_t *tab, unsigned row, unsigned col, char *text);
 extern void gui_table_show(gui_table_t *tab, unsigned dx, unsigned dy);
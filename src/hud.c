@@ -0,0 +1,190 @@
+/*
+ * hud.c: overlay showing how fast the game draws and plays
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hud.h"
+
+#define HUD_X			2		// Top left corner, clear of every hand
+#define HUD_Y			2
+#define HUD_COLUMNS		18
+#define HUD_LINES		5
+#define HUD_MARGIN		4
+#define HUD_FG			0xffff00
+#define HUD_BG			0x000000
+
+boolean_t hud_enabled = FALSE;
+long long hud_drawing = 0;		// Time spent drawing cards so far, in nanoseconds
+static render_frame_t *layer = NULL;
+static long long samples[HUD_NSAMPLES];	// Last sample taken by each probe, in nanoseconds
+static long long since = 0;		// When the current interval started
+static unsigned long frames = 0;	// Counters of the frame when it started
+static unsigned long requests = 0;
+static unsigned long long presented = 0;
+static double fps = 0, rps = 0, dirty = 0;	// Figures of the last interval
+
+/*
+ *
+ * Show the HUD on top of @fr, or hide it if @show is FALSE. Its figures are
+ * computed over intervals of HUD_INTERVAL milliseconds, the first of which
+ * starts now. Return 0 on success or -1 on allocation errors.
+ *
+ */
+int hud_show(render_frame_t *fr, boolean_t show)
+{
+	unsigned w = fr->fnt_width ? fr->fnt_width : 6;
+	unsigned h = fr->fnt_ascent + fr->fnt_descent ? fr->fnt_ascent + fr->fnt_descent : 13;
+
+
+	if (!show) {
+		if (!layer)
+			return 0;
+		hud_enabled = FALSE;
+		hud_redraw(fr);
+		render_destroyframe(layer);
+		layer = NULL;
+		return 0;
+	}
+
+	if (!layer) {
+		layer = render_newlayer(fr, HUD_COLUMNS * w + 2 * HUD_MARGIN, HUD_LINES * h + 2 * HUD_MARGIN);
+		if (!layer)
+			return -1;
+	}
+	memset(samples, 0, sizeof(samples));
+	fps = rps = dirty = 0;
+	since = bench_time_nsecs();
+	frames = fr->frames;
+	requests = fr->requests;
+	presented = fr->presented;
+	hud_enabled = TRUE;
+	hud_redraw(fr);
+
+	return 0;
+}
+
+/*
+ *
+ * Take @nsecs as the last sample of the probe @id.
+ *
+ */
+void hud_sample(hud_sample_id_t id, long long nsecs)
+{
+	samples[id] = nsecs;
+}
+
+/*
+ *
+ * Draw the HUD with the figures of the last interval on top of @fr, or
+ * remove it once disabled, and send it at once, e.g., once @fr has been
+ * resized, which leaves the HUD blank. What was drawn on @fr is sent first,
+ * and the HUD waits for it to reach the server, so that what the HUD sends
+ * for itself is left out of the counters of @fr it reports.
+ *
+ */
+void hud_redraw(render_frame_t *fr)
+{
+	char line[HUD_LINES][32];
+	unsigned i, h;
+	unsigned long f, r;
+	unsigned long long p;
+
+
+	if (!layer)
+		return;
+
+	render_flush(fr);
+	render_finish(fr);
+	f = fr->frames;
+	r = fr->requests;
+	p = fr->presented;
+	if (!hud_enabled) {
+		render_showlayer(fr, HUD_DEPTH, NULL, 0, 0);
+		goto fnflush;
+	}
+	if (fr->overlay[HUD_DEPTH] != layer)
+		render_showlayer(fr, HUD_DEPTH, layer, HUD_X, HUD_Y);
+
+	h = layer->fnt_ascent + layer->fnt_descent;
+	if (!h)
+		h = 13;
+
+	snprintf(line[0], sizeof(line[0]), "%-6s%9.1f", "fps", fps);
+	snprintf(line[1], sizeof(line[1]), "%-6s%9.3f ms", "anim", samples[HUD_ANIMATE_FRAME] / 1000000.0);
+	snprintf(line[2], sizeof(line[2]), "%-6s%9.3f ms", "think", samples[HUD_BOT_THINK] / 1000000.0);
+	snprintf(line[3], sizeof(line[3]), "%-6s%9.0f", "req/s", rps);
+	snprintf(line[4], sizeof(line[4]), "%-6s%9.0f px", "dirty", dirty);
+
+	render_fill(layer, HUD_BG, 0, 0, layer->vwidth, layer->vheight);
+	for (i=0;i<HUD_LINES;i++)
+		render_text(layer, HUD_FG, HUD_BG, HUD_MARGIN, HUD_MARGIN + layer->fnt_ascent + i * h,
+			    line[i], strlen(line[i]));
+
+fnflush:
+	render_flush(fr);
+	render_finish(fr);
+	fr->frames = f;
+	fr->requests = r;
+	fr->presented = p;
+}
+
+/*
+ *
+ * Compute the figures of the interval which has just elapsed, if any, from
+ * the counters of @fr and draw them. Called right after @fr is flushed.
+ *
+ */
+void hud_update(render_frame_t *fr)
+{
+	long long now = bench_time_nsecs();
+	double secs = (now - since) / 1000000000.0;
+
+
+	if (!hud_enabled || now - since < HUD_INTERVAL * 1000000LL)
+		return;
+
+	fps = (fr->frames - frames) / secs;
+	rps = (fr->requests - requests) / secs;
+	dirty = fr->frames != frames ? (double)(fr->presented - presented) / (fr->frames - frames) : 0;
+	since = now;
+	frames = fr->frames;
+	requests = fr->requests;
+	presented = fr->presented;
+	hud_redraw(fr);
+}
+
+/*
+ *
+ * Return how many milliseconds the game can sleep before the HUD must be
+ * updated, or -1 if it is hidden, as poll() expects.
+ *
+ */
+int hud_timeout(void)
+{
+	long long left;
+
+
+	if (!hud_enabled)
+		return -1;
+
+	left = HUD_INTERVAL - (bench_time_nsecs() - since) / 1000000;
+	return left > 0 ? (int)left : 0;
+}
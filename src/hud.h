@@ -0,0 +1,52 @@
+/*
+ *
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _SRC_HUD_H_
+#define _SRC_HUD_H_
+#ifndef _HAVE_BOOLEAN_T_
+#define _HAVE_BOOLEAN_T_
+typedef enum { FALSE=0, TRUE } boolean_t;
+#endif
+#include "render.h"
+#include "bench.h"
+
+#define HUD_INTERVAL		500		// Milliseconds between updates of the figures
+#define HUD_DEPTH		1		// Layer it is shown at, above dialogs
+
+typedef enum {
+	HUD_ANIMATE_FRAME=0,
+	HUD_BOT_THINK,
+	HUD_NSAMPLES
+} hud_sample_id_t;
+
+extern boolean_t hud_enabled;
+extern long long hud_drawing;
+
+// Probes cost a test of hud_enabled when the HUD is hidden
+#define HUD_START(t)		((t) = hud_enabled ? bench_time_nsecs() : 0)
+#define HUD_STOP(id, t)		do { if (hud_enabled) hud_sample(id, bench_time_nsecs() - (t)); } while (0)
+#define HUD_DRAWN(t)		do { if (hud_enabled) hud_drawing += bench_time_nsecs() - (t); } while (0)
+
+extern int hud_show(render_frame_t *fr, boolean_t show);
+extern void hud_sample(hud_sample_id_t id, long long nsecs);
+extern void hud_redraw(render_frame_t *fr);
+extern void hud_update(render_frame_t *fr);
+extern int hud_timeout(void);
+#endif
@@ -25,12 +25,20 @@
 #include <getopt.h>
 #include <errno.h>
 #include <time.h>
+#include <poll.h>
+#include <limits.h>
+#include <pthread.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/keysym.h>
 #include <png.h>
 #undef TRUE
 #undef FALSE
 #include "gui.h"
+#include "render.h"
+#include "bench.h"
+#include "rescache.h"
+#include "hud.h"
 #include "dllst.h"
 #include "digraph.h"
 #include "misc.h"
@@ -77,6 +85,7 @@
 #define BOT_3_X			(800 - 10 - CARD_WIDTH)
 #define BOT_3_Y			128
 #define NRESOURCES		66
+#define MAX_HAND		52		// Cards a player could hold, at most
 #define RES_PLAYING_DISABLED	52
 #define RES_PLAYING_ENABLED	53
 #define RES_CLUBS		54
@@ -93,22 +102,42 @@
 #define RES_DECK_LOCKED		65
 #define RES_SUIT_BASE		54
 #define RES_SUIT_BASE_INV	58
+#define ANIM_DURATION		250000		// Microseconds taken by each card move
+#define FRAME_TIME		16667		// Microseconds between frames (60 fps)
+#define MAX_COLORS		65536
+#define MAX_LOADERS		4		// Threads decoding resources in the background
+#define EMPTY_COLOR		0xffffffff	// Never returned by decode_png()
+#define COLOR_TABLE		0x006600
+#define COLOR_SELECTOR		0xffffff
+#define COLOR_NAME		0xffffff
+#define BUTTON_NEWHAND		1
+#define BUTTON_NEWGAME		2
+#define RESDIR			"/usr/local/share/nullify/res"
+#define TABLE_WIDTH		800		// Size of the table, which is scaled to fit in the window
+#define TABLE_HEIGHT		600
+#define BENCH_SEED		0x5eed		// Hand played by benchmarks unless --seed is given
+#define BENCH_MAX_TURNS		500
+#define KEY_HUD			XK_F3		// Shows or hides the HUD
 
 // user-defined types and global variables
 typedef enum { EXPOSURE_CARD=0, DELETE_CARD, ADD_CARD, GET_CARD } action_t;
 typedef enum { EXPOSURE_SUIT=0, SELECT_SUIT, SELECT_NONE } action_table_t;
+typedef enum { LOAD_PENDING=0, LOAD_BUSY, LOAD_DONE } load_state_t;
 
 Display *display;
 Window window;
 XEvent event;
-Pixmap cardpixmap;
-GC gc_table, gc_selector, gc_white, gc_black, gc_anim[8];
-timer_t deck_timer, playing_timer, table_timer;
+unsigned long color_anim[8] = {
+	0xf6c182, 0xd3198d, 0xf9280c, 0x8536fb, 0x3697fb, 0x6aff56, 0xeaf6a9, 0xff9d3e
+};
+wheel_timer_t deck_timer, playing_timer, table_timer;
 unsigned turn, ngame, nhand;
 struct resource_st {
-	png_bytepp bytes;
-	GC *color;
+	void *indices;			// Either owned or pointing into one of the card atlases
+	unsigned isize;			// Size of each index: 1 byte, or 2 if there are more than 256 colors
+	unsigned int *palette;		// 0x00RRGGBB words
 	unsigned ncolors;
+	unsigned stride;		// Distance in indices between two rows of the image
 	unsigned width;
 	unsigned height;
 	struct {
@@ -117,7 +146,40 @@ struct resource_st {
 		int x1;
 		int y1;
 	} region;
+	render_sprite_t sprite;		// Resampled for the scale of the window
 } resource[NRESOURCES] = { 0 };
+struct resource_st card_atlas[4] = { 0 };
+struct load_st {
+	const char *name;		// png-image in the resource directory
+	int res;			// Resource it is loaded into, or first card of the atlas
+	int suit;			// Atlas of the cards of a suit, -1 if none
+	load_state_t state;		// Changed with load_mutex held
+	rescache_image_t image;		// As found in the cache file, or to be stored there
+	boolean_t decoded;		// Whether it had to be decoded, the cache file being stale
+} load_job[] = {
+	{ "deck.png",             RES_DECK,             -1,            LOAD_PENDING },
+	{ "deck-locked.png",      RES_DECK_LOCKED,      -1,            LOAD_PENDING },
+	{ "suit-clubs.png",       CARD_ACE(SUIT_CLUBS),    SUIT_CLUBS,    LOAD_PENDING },
+	{ "suit-diamonds.png",    CARD_ACE(SUIT_DIAMONDS), SUIT_DIAMONDS, LOAD_PENDING },
+	{ "suit-hearts.png",      CARD_ACE(SUIT_HEARTS),   SUIT_HEARTS,   LOAD_PENDING },
+	{ "suit-spades.png",      CARD_ACE(SUIT_SPADES),   SUIT_SPADES,   LOAD_PENDING },
+	{ "playing_disabled.png", RES_PLAYING_DISABLED, -1,            LOAD_PENDING },
+	{ "playing_enabled.png",  RES_PLAYING_ENABLED,  -1,            LOAD_PENDING },
+	{ "clubs.png",            RES_CLUBS,            -1,            LOAD_PENDING },
+	{ "diamonds.png",         RES_DIAMONDS,         -1,            LOAD_PENDING },
+	{ "hearts.png",           RES_HEARTS,           -1,            LOAD_PENDING },
+	{ "spades.png",           RES_SPADES,           -1,            LOAD_PENDING },
+	{ "clubs-inv.png",        RES_CLUBS_INV,        -1,            LOAD_PENDING },
+	{ "diamonds-inv.png",     RES_DIAMONDS_INV,     -1,            LOAD_PENDING },
+	{ "hearts-inv.png",       RES_HEARTS_INV,       -1,            LOAD_PENDING },
+	{ "spades-inv.png",       RES_SPADES_INV,       -1,            LOAD_PENDING },
+	{ "arrow-cw.png",         RES_ARROW_CW,         -1,            LOAD_PENDING },
+	{ "arrow-ccw.png",        RES_ARROW_CCW,        -1,            LOAD_PENDING },
+};
+pthread_t loader[MAX_LOADERS];
+unsigned nloaders = 0;
+pthread_mutex_t load_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t load_cond = PTHREAD_COND_INITIALIZER;
 struct player_st {
 	char name[20];
 	boolean_t active;		// Whether the player is still active in the hand or not
@@ -128,17 +190,36 @@ struct player_st {
 } player[NPLAYERS] = { 0 };
 dllst_t *deck_list = NULL, *played_list = NULL;
 int card_row[NPLAYERS] = { 0 };
+struct slot_st {
+	int x;				// Where the card is drawn
+	int y;
+	int dx;				// Half the width of the part of the card left visible by the next one
+	int card;			// suit * 13 + number
+	int res;			// Resource drawn, either the card or its back
+	boolean_t selectable;		// Whether it has a selector, so that the human player can play it
+};
+struct layout_st {
+	int ncards;
+	struct slot_st slot[MAX_HAND];
+} layout[NPLAYERS] = { 0 };		// Hands as last drawn by update_cards()
 int playing_x[NPLAYERS] = { 0 }, playing_y[NPLAYERS] = { 0 };
 int getatmost, lastsuit, rotation;
 char *suitstr[] = { "CLUBS", "DIAMONDS", "HEARTS", "SPADES" };
 boolean_t hand_finished = FALSE;
 gui_dialog_t *dialog = NULL;
-gui_button_t *newhand_button = NULL, *newgame_button = NULL;
+render_frame_t *frame = NULL;
 int skipframes = 2;
 int game_total = 16;
 boolean_t show_bot_cards = FALSE;
+boolean_t turbo = FALSE;		// Bots play without drawing anything, see set_turbo()
 char *logfilename = NULL;
 char *userdir = NULL;
+char *resdir = RESDIR;
+char *offscreen = NULL;
+char *benchfile = NULL;
+char *cachefile = NULL;
+unsigned win_width = TABLE_WIDTH, win_height = TABLE_HEIGHT;
+long rseed = 0;
 #if defined(HAVE_XML_LOGS)
 boolean_t savelog = FALSE;
 int replaygame = 0, replayhand = 0;
@@ -154,7 +235,17 @@ struct {
 } fields = { 0 };
 
 // local function declarations
-int load_resource(struct resource_st *res, const char *filename, int xoffset, int stop);
+char *res_path(const char *name);
+unsigned int *decode_png(const char *filename, unsigned *width, unsigned *height);
+int index_resource(struct resource_st *res, unsigned int *pixels, unsigned n);
+int load_resource(struct resource_st *res, const char *filename);
+void split_atlas(struct resource_st *res, struct resource_st *sheet, unsigned n, unsigned width);
+void run_load(struct load_st *job);
+void save_cache(void);
+void *loader_thread(void *arg);
+void start_loading(void);
+void wait_resource(struct resource_st *res);
+void finish_loading(void);
 void render_resource(struct resource_st *res, int X, int Y);
 void init_deck(void);
 void lock_deck(void);
@@ -163,35 +254,48 @@ int init_players(int n);
 void init_hand(void);
 void add_selector(struct resource_st *card, int x, int dx, int y);
 void del_selector(struct resource_st *card, int x, int dx, int y);
+void card_position(int nplayer, int ncards, int i, struct slot_st *slot);
+boolean_t card_selectable(dllst_item_struct_t *iter, action_t act);
 void update_cards(int nplayer, action_t act, void *param);
 void update_table(action_table_t act);
 void update_turn(int flags);
 char *decode_card(int suit, int number, boolean_t addnode);
 void animate_card(int nplayer, boolean_t isplaying, int suit, int number);
+void set_turbo(boolean_t enable);
 int getcardfromdeck(int nplayer, action_t act);
 void playcard(int n, int suit, int number, unsigned long *param);
-void bot_calc_probabilities(int n);
+void bot_calc_probabilities(int n, unsigned *unseen);
 void bot_play(int n);
+void bot_turn(int n);
 int getactiveplayers(void);
 void finish_hand(void);
+void draw_status(void);
+void redraw_table(void);
 void do_exposure(XExposeEvent *ep);
+void do_resize(unsigned width, unsigned height);
 void do_buttondown(XButtonEvent *bp);
-void do_timer(union sigval tp);
+void do_keydown(XKeyEvent *kp);
+void do_timer(int arg);
 void do_exit(void);
+int bench_hand(const char *filename);
 
 int main(int argc, char **argv, char **env)
 {
-	int i, j, opt;
-	char filename[96] = { '\0' };
+	int opt;
 	char str[64] = { '\0' };
 	Pixmap iconpixmap = { 0 };
 	unsigned iconwidth, iconheight;
 	XSizeHints hints;
+	struct pollfd pfd[2];
 	struct option longoptions[] = {
 		{ "name",       required_argument, NULL, 'n' },
 		{ "debug",      no_argument, NULL, 'd' },
 		{ "skipframes", required_argument, NULL, 'f' },
 		{ "total",      required_argument, NULL, 't' },
+		{ "seed",       required_argument, NULL, 'S' },
+		{ "offscreen",  required_argument, NULL, 'o' },
+		{ "bench",      required_argument, NULL, 'B' },
+		{ "geometry",   required_argument, NULL, 'g' },
 #if defined(HAVE_XML_LOGS)
 		{ "savelog",    no_argument, NULL, 's' },
 		{ "logfile",    required_argument, NULL, 'l' },
@@ -205,48 +309,20 @@ int main(int argc, char **argv, char **env)
 	};
 #if defined(HAVE_XML_LOGS)
 	xmlNodePtr rootnode = NULL;
+	int i;
 #endif
 
 
+	// Frames are sent by a thread of their own, through Xlib as well
 	XInitThreads();
-	display = XOpenDisplay("");
-	window = XCreateSimpleWindow(display, XDefaultRootWindow(display), 0, 0, 800, 600, 1, 0, 0);
-	XSelectInput(display, window, ExposureMask|ButtonPressMask);
-	hints.min_width = 800;
-	hints.min_height = 600;
-	hints.max_width = 800;
-	hints.max_height = 600;
-	hints.flags = PMinSize|PMaxSize;
-	XReadBitmapFile(display, window, "/usr/local/share/nullify/res/icon.xbm",
-			&iconwidth, &iconheight, &iconpixmap, NULL, NULL);
-	XSetStandardProperties(display, window, PACKAGE_STRING, NULL, iconpixmap, argv, argc, &hints);
-	XMapRaised(display, window);
-
-	gc_white    = XCreateGC(display, window, 0, NULL);
-	gc_black    = XCreateGC(display, window, 0, NULL);
-	gc_table    = XCreateGC(display, window, 0, NULL);
-	gc_selector = XCreateGC(display, window, 0, NULL);
-	for (i=0;i<8;i++) {
-		gc_anim[i] = XCreateGC(display, window, 0, NULL);
-		XSetArcMode(display, gc_anim[i], ArcPieSlice);
-	}
-	XSetForeground(display, gc_white,    0xffffff);
-	XSetBackground(display, gc_white,    0x006600);
-	XSetForeground(display, gc_black,    0x404040);
-	XSetBackground(display, gc_black,    0xa0a0a0);
-	XSetForeground(display, gc_table,    0x006600);
-	XSetForeground(display, gc_selector, 0xffffff);
-	XSetForeground(display, gc_anim[0],  0xf6c182);
-	XSetForeground(display, gc_anim[1],  0xd3198d);
-	XSetForeground(display, gc_anim[2],  0xf9280c);
-	XSetForeground(display, gc_anim[3],  0x8536fb);
-	XSetForeground(display, gc_anim[4],  0x3697fb);
-	XSetForeground(display, gc_anim[5],  0x6aff56);
-	XSetForeground(display, gc_anim[6],  0xeaf6a9);
-	XSetForeground(display, gc_anim[7],  0xff9d3e);
+	bench_launch();
+
+	// Resources may be read from somewhere else than the installation directory
+	if (getenv("NULLIFY_RESDIR"))
+		resdir = getenv("NULLIFY_RESDIR");
 
 	// Read game settings from the installation data directory
-	if (parse_conf_file("/usr/local/share/nullify/res/nullify.conf")) {
+	if (parse_conf_file(res_path("nullify.conf"))) {
 		strcpy(player[0].name, "Human");
 		strcpy(player[1].name, "Bot_1");
 		strcpy(player[2].name, "Bot_2");
@@ -255,7 +331,7 @@ int main(int argc, char **argv, char **env)
 	}
 
 	// Parse the command line options
-	while ((opt = getopt_long(argc, argv, "n:df:sl:t:R:H:L:vh", longoptions, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "n:df:t:S:o:B:g:sl:R:H:L:vh", longoptions, NULL)) != -1) {
 		switch (opt) {
 		case 'n':
 			strncpy(player[0].name, optarg, 19);
@@ -273,6 +349,21 @@ int main(int argc, char **argv, char **env)
 			if (game_total < 1)
 				game_total = 16;
 			break;
+		case 'S':
+			rseed = strtol(optarg, NULL, 0);
+			break;
+		case 'o':
+			offscreen = optarg;
+			break;
+		case 'B':
+			benchfile = optarg;
+			break;
+		case 'g':
+			if (sscanf(optarg, "%ux%u", &win_width, &win_height) != 2 || !win_width || !win_height) {
+				win_width = TABLE_WIDTH;
+				win_height = TABLE_HEIGHT;
+			}
+			break;
 #if defined(HAVE_XML_LOGS)
 		case 's':
 			savelog = TRUE;
@@ -308,6 +399,36 @@ int main(int argc, char **argv, char **env)
 		};
 	}
 
+	if (offscreen) {
+		// Draw in memory only, without any X server
+		frame = render_newframe_mem(TABLE_WIDTH, TABLE_HEIGHT);
+	} else {
+		display = XOpenDisplay("");
+		if (!display) {
+			printf("Could not open the X display\n");
+			return 1;
+		}
+		window = XCreateSimpleWindow(display, XDefaultRootWindow(display), 0, 0,
+					     win_width, win_height, 1, 0, 0);
+		XSelectInput(display, window, ExposureMask|ButtonPressMask|KeyPressMask|StructureNotifyMask);
+		hints.min_width = TABLE_WIDTH / 2;
+		hints.min_height = TABLE_HEIGHT / 2;
+		hints.flags = PMinSize;
+		XReadBitmapFile(display, window, res_path("icon.xbm"),
+				&iconwidth, &iconheight, &iconpixmap, NULL, NULL);
+		XSetStandardProperties(display, window, PACKAGE_STRING, NULL, iconpixmap, argv, argc, &hints);
+		XMapRaised(display, window);
+
+		frame = render_newframe_x11(display, window, TABLE_WIDTH, TABLE_HEIGHT);
+	}
+
+	// Everything is drawn on a back buffer and only what changed is sent. The
+	// table keeps its size and is scaled to the size of the window.
+	if (!frame || render_resize(frame, win_width, win_height)) {
+		printf("Could not allocate the back buffer of the window\n");
+		return 1;
+	}
+
 #if defined(HAVE_XML_LOGS)
 	// Create the root node of the XML file
 	do_LIBXML_TEST_VERSION;
@@ -338,42 +459,12 @@ int main(int argc, char **argv, char **env)
 	}
 #endif
 
+	// Images are decoded in the background, or when first drawn if sooner
 	dllst_verbose = 0;
-	for (i=0;i<4;i++) {
-		strcpy(filename, "/usr/local/share/nullify/res/");
-		switch (i) {
-		case 0:
-			strcat(filename, "suit-clubs.png");
-			break;
-		case 1:
-			strcat(filename, "suit-diamonds.png");
-			break;
-		case 2:
-			strcat(filename, "suit-hearts.png");
-			break;
-		case 3:
-			strcat(filename, "suit-spades.png");
-			break;
-		};
-
-		for (j=0;j<13;j++)
-			load_resource(&resource[i * 13 + j], filename, j * CARD_WIDTH, CARD_WIDTH);
-		memset(filename, '\0', 96);
-	}
-	load_resource(&resource[RES_PLAYING_DISABLED], "/usr/local/share/nullify/res/playing_disabled.png", -1, -1);
-	load_resource(&resource[RES_PLAYING_ENABLED], "/usr/local/share/nullify/res/playing_enabled.png", -1, -1);
-	load_resource(&resource[RES_CLUBS], "/usr/local/share/nullify/res/clubs.png", -1, -1);
-	load_resource(&resource[RES_DIAMONDS], "/usr/local/share/nullify/res/diamonds.png", -1, -1);
-	load_resource(&resource[RES_HEARTS], "/usr/local/share/nullify/res/hearts.png", -1, -1);
-	load_resource(&resource[RES_SPADES], "/usr/local/share/nullify/res/spades.png", -1, -1);
-	load_resource(&resource[RES_CLUBS_INV], "/usr/local/share/nullify/res/clubs-inv.png", -1, -1);
-	load_resource(&resource[RES_DIAMONDS_INV], "/usr/local/share/nullify/res/diamonds-inv.png", -1, -1);
-	load_resource(&resource[RES_HEARTS_INV], "/usr/local/share/nullify/res/hearts-inv.png", -1, -1);
-	load_resource(&resource[RES_SPADES_INV], "/usr/local/share/nullify/res/spades-inv.png", -1, -1);
-	load_resource(&resource[RES_ARROW_CW], "/usr/local/share/nullify/res/arrow-cw.png", -1, -1);
-	load_resource(&resource[RES_ARROW_CCW], "/usr/local/share/nullify/res/arrow-ccw.png", -1, -1);
-	load_resource(&resource[RES_DECK], "/usr/local/share/nullify/res/deck.png", -1, -1);
-	load_resource(&resource[RES_DECK_LOCKED], "/usr/local/share/nullify/res/deck-locked.png", -1, -1);
+	cachefile = rescache_defaultfile();
+	if (cachefile)
+		rescache_open(cachefile);
+	start_loading();
 
 	card_row[0] = 600 - CARD_HEIGHT - 10;
 	card_row[2] = 10;
@@ -393,50 +484,95 @@ int main(int argc, char **argv, char **env)
 	userdir = expand_tilde(env);
 	atexit(do_exit);
 
-	XNextEvent(display, &event);
-	if (event.type == Expose) {
-		dialog = gui_newdialog(display, window, "Nullify", 60, 80, 680, 450);
-		print_rules(dialog, "/usr/local/share/nullify/res/rules.txt");
-		newhand_button = gui_addbutton(dialog, "Start", 620, 400);
-		hand_finished = TRUE;
-		cardpixmap = XCreatePixmap(display, window, CARD_WIDTH, CARD_HEIGHT,
-					  XDefaultScreenOfDisplay(display)->root_depth);
+	if (!offscreen) {
+		// the window must be mapped before anything is drawn on it, at
+		// whatever size the window manager chose
+		do {
+			XNextEvent(display, &event);
+			if (event.type == ConfigureNotify)
+				do_resize(event.xconfigure.width, event.xconfigure.height);
+		} while (event.type != Expose);
 	}
 
-	// X main loop
+	if (benchfile)
+		return bench_hand(benchfile);
+
+	if (offscreen) {
+		// Deal a hand, draw the table and write it to a file, e.g., to check
+		// the rendering against a known image
+		init_hand();
+		do_exposure(NULL);
+		render_flush(frame);
+		return render_savepng(frame, offscreen) ? 1 : 0;
+	}
+
+	dialog = gui_newdialog(frame, "Nullify", 60, 80, 680, 450);
+	print_rules(dialog, res_path("rules.txt"));
+	gui_addbutton(dialog, "Start", 620, 400, BUTTON_NEWHAND);
+	hand_finished = TRUE;
+	if (show_bot_cards)
+		hud_show(frame, TRUE);
+
+	// X main loop: sleep until there is something to do, then handle all of it
+	pfd[0].fd = ConnectionNumber(display);
+	pfd[0].events = POLLIN;
+	pfd[1].fd = do_timer_fd();
+	pfd[1].events = POLLIN;
 	while (1) {
-		if (XCheckMaskEvent(display, ExposureMask|ButtonPressMask, &event)) {
+		while (XPending(display)) {
+			XNextEvent(display, &event);
 			switch(event.type) {
 			case Expose:
-				if (newhand_button || newgame_button)
-					init_hand();
-				if (!event.xexpose.count)
-					do_exposure(&event.xexpose);
-
-				hand_finished = FALSE;
-				free(newhand_button);
-				newhand_button = NULL;
-				free(newgame_button);
-				newgame_button = NULL;
+				do_exposure(&event.xexpose);
 				break;
 			case ButtonPress:
 				do_buttondown(&event.xbutton);
 				break;
+			case KeyPress:
+				do_keydown(&event.xkey);
+				break;
+			case ConfigureNotify:
+				do_resize(event.xconfigure.width, event.xconfigure.height);
+				break;
 			};
 		}
+
+		// exposed areas and whatever timers drew are sent at once
+		gui_update(dialog);
+		render_flush(frame);
+		bench_firstframe(frame);
+		hud_update(frame);
+		if (poll(pfd, 2, hud_timeout()) == -1 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+		if (pfd[1].revents & POLLIN)
+			do_timer_dispatch();
 	}
+	return 1;
 
 usage:
 	printf("%s\n", PACKAGE_STRING);
 	printf("Usage: %s [options]\n", PACKAGE);
 	printf("Available options are:\n");
 	printf("  -n --name=<yourname>     Set your name to something other than \"Human\"\n");
-	printf("  -d --debug               It allows show the cards of the bots\n");
-	printf("  -f --skipframes=<n>      Set the amount of frames to skip during animations.\n");
+	printf("  -d --debug               It allows show the cards of the bots, and shows the HUD\n");
+	printf("                           with frame times and bot think times (F3 toggles it)\n");
+	printf("  -f --skipframes=<n>      Set the amount of frames to skip during animations, which\n");
+	printf("                           run at 60 fps and last the same time regardless.\n");
 	printf("                           <n> must be an integer different than zero\n");
 	printf("\n");
 	printf("  -t --total=<n>           Specify play each game up to <n> points is to be reached\n");
 	printf("                           (default = 16)\n");
+	printf("  -S --seed=<n>            Deal every hand with the random seed <n> rather than\n");
+	printf("                           with the current time\n");
+	printf("  -o --offscreen=<file>    Deal a hand without any X server, draw the table in\n");
+	printf("                           memory, write it to png-image <file> and exit\n");
+	printf("  -B --bench=<file>        Let bots play a whole hand, measure the rendering code,\n");
+	printf("                           write the results to <file> as JSON and exit\n");
+	printf("  -g --geometry=<w>x<h>    Open a window of <w> x <h> pixels rather than 800x600\n");
+	printf("                           (the table is scaled to fit in it, as when resizing it)\n");
+	printf("\n");
 #if defined(HAVE_XML_LOGS)
 	printf("  -s --savelog             Save the session log when the game exits (it must have\n");
 	printf("                           been compiled with the --enable-xml-logs=yes option)\n");
@@ -451,36 +587,50 @@ usage:
 #endif
 	printf("  -v --version             Print the program version and exit\n");
 	printf("  -h --help                Display this message\n");
+	printf("\n");
+	printf("Resources are read from $NULLIFY_RESDIR if set, or from %s otherwise.\n", RESDIR);
 	return -1;
 }
 
 /*
  *
- * Load png-image @filename and store it in @res. @xoffset and @stop, if given
- * other than -1, allow load the subimage starting at (@xoffset, 0) and ending at
- * (@xoffset + @stop, image-height) coordinates.
+ * Return the path of the resource file @name, which is looked up in the
+ * directory given by the NULLIFY_RESDIR environment variable, if any, or in
+ * the installation data directory otherwise. The returned string is
+ * overwritten by the next call.
  *
  */
-int load_resource(struct resource_st *res, const char *filename, int xoffset, int stop)
+char *res_path(const char *name)
+{
+	static char path[PATH_MAX];
+
+
+	snprintf(path, sizeof(path), "%s/%s", resdir, name);
+	return path;
+}
+
+/*
+ *
+ * Decode png-image @filename into a single buffer of 0x00RRGGBB words, whose
+ * dimensions are stored in @width and @height. Rows are read one at a time
+ * and converted in place, so that no other allocation is needed. Return the
+ * buffer, which must be freed by the caller, or NULL on errors.
+ *
+ */
+unsigned int *decode_png(const char *filename, unsigned *width, unsigned *height)
 {
 	int x, y;
 	FILE *fileptr;
-	dllst_t *dllst = NULL;
-	dllst_item_struct_t *iter;
-	struct {
-		unsigned int color;
-		void *unused0;
-	} fields2 = { 0 };
 	png_structp png_ptr   = NULL;
 	png_infop png_infoptr = NULL;
-	png_bytepp subimage = NULL;
-	unsigned width, height;
+	png_bytep row;
+	unsigned int *pixels = NULL;
 
 
 	fileptr = fopen(filename, "rb");
 	if (!fileptr) {
 		perror("fopen");
-		return -1;
+		return NULL;
 	}
 
 	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -491,138 +641,330 @@ int load_resource(struct resource_st *res, const char *filename, int xoffset, in
 // This should work on the most of the systems. See BUGS for further information.
 #if PNG_LIBPNG_VER >= 10500
 	// libpng-1.5.0+
-	width = png_get_image_width(png_ptr, png_infoptr);
-	height = png_get_image_height(png_ptr, png_infoptr);
+	*width = png_get_image_width(png_ptr, png_infoptr);
+	*height = png_get_image_height(png_ptr, png_infoptr);
 #else
-	width = png_infoptr->width;
-	height = png_infoptr->height;
+	*width = png_infoptr->width;
+	*height = png_infoptr->height;
 #endif
 
-	res->bytes = (png_bytepp)malloc(height * sizeof(png_bytep));
-	if (!res->bytes) {
+	// 3-byte RGB rows take no more room than the final 4-byte pixels
+	pixels = (unsigned int *)malloc(*width * *height * sizeof(unsigned int));
+	if (!pixels) {
 		perror("malloc");
-		return -1;
+		goto fnreturn;
 	}
-	
-	for (y=0;y<height;y++) {
-		res->bytes[y] = (png_bytep)malloc(width * 3);
-		if (!res->bytes[y]) {
-			perror("malloc");
-			return -1;
-		}
+
+	for (y=0;y<*height;y++) {
+		row = (png_bytep)(pixels + y * *width);
+		png_read_row(png_ptr, row, NULL);
+		for (x=*width-1;x>=0;x--)
+			pixels[y * *width + x] = (row[x * 3] << 16)|(row[x * 3 + 1] << 8)|(row[x * 3 + 2] << 0);
 	}
-	png_read_image(png_ptr, res->bytes);
 	png_read_end(png_ptr, png_infoptr);
 
-	if (xoffset < width && stop != -1) {
-		subimage = (png_bytepp)malloc(height * sizeof(png_bytep));
-		if (!subimage) {
-			perror("malloc");
-			return -1;
-		}
+fnreturn:
+	png_destroy_read_struct(&png_ptr, &png_infoptr, NULL);
+	fclose(fileptr);
 
-		for (y=0;y<height;y++) {
-			subimage[y] = (png_bytep)malloc(stop * 3);
-			if (!subimage[y]) {
-				perror("malloc");
-				return -1;
-			}
-		}
+	return pixels;
+}
 
-		for (y=0;y<height;y++)
-			for (x=0;x<stop * 3;x++)
-				subimage[y][x] = res->bytes[y][xoffset * 3 + x];
+/*
+ *
+ * Turn the @n pixels at @pixels into indices into a palette of their colors,
+ * which is stored in @res along with the size of each index. Colors are looked
+ * up in a hash table with open addressing, so that each pixel costs O(1).
+ * Indices are written over @pixels, whose ownership passes to @res.
+ *
+ */
+int index_resource(struct resource_st *res, unsigned int *pixels, unsigned n)
+{
+	struct {
+		unsigned int color;
+		unsigned int index;
+	} *hash = NULL;
+	unsigned i, k, size, shift, ncolors = 0;
+	unsigned int *palette = NULL;
+	void *indices;
 
-		for (y=0;y<height;y++) {
-			free(res->bytes[y]);
-			res->bytes[y] = NULL;
-		}
-		free(res->bytes);
-		res->bytes = NULL;
 
-		res->bytes = (png_bytepp)malloc(height * sizeof(png_bytep));
-		if (!res->bytes) {
-			perror("malloc");
-			return -1;
-		}
-		
-		for (y=0;y<height;y++) {
-			res->bytes[y] = (png_bytep)malloc(stop * 3);
-			if (!res->bytes[y]) {
-				perror("malloc");
-				return -1;
-			}
+	for (size=2,shift=31;size<2*n && size<2*MAX_COLORS;size<<=1,shift--);
+	hash = malloc(size * sizeof(*hash));
+	palette = (unsigned int *)malloc((n < MAX_COLORS ? n : MAX_COLORS) * sizeof(unsigned int));
+	if (!hash || !palette) {
+		perror("malloc");
+		goto fnerror;
+	}
+	memset(hash, 0xff, size * sizeof(*hash));
+
+	// first pass: collect the colors
+	for (i=0;i<n;i++) {
+		k = (pixels[i] * 2654435761u) >> shift;
+		while (hash[k].color != EMPTY_COLOR && hash[k].color != pixels[i])
+			k = (k + 1) & (size - 1);
+		if (hash[k].color != EMPTY_COLOR)
+			continue;
+
+		if (ncolors == MAX_COLORS) {
+			printf("Images with more than %d colors are not supported\n", MAX_COLORS);
+			goto fnerror;
 		}
+		hash[k].color = pixels[i];
+		hash[k].index = ncolors;
+		palette[ncolors++] = pixels[i];
+	}
+
+	// second pass: replace each pixel by its index (never beyond what is left to read)
+	res->isize = ncolors <= 256 ? 1 : 2;
+	for (i=0;i<n;i++) {
+		k = (pixels[i] * 2654435761u) >> shift;
+		while (hash[k].color != pixels[i])
+			k = (k + 1) & (size - 1);
+		if (res->isize == 1)
+			((unsigned char *)pixels)[i] = hash[k].index;
+		else
+			((unsigned short *)pixels)[i] = hash[k].index;
+	}
+	free(hash);
+
+	indices = realloc(pixels, n * res->isize);
+	res->indices = indices ? indices : pixels;
+	res->palette = (unsigned int *)realloc(palette, ncolors * sizeof(unsigned int));
+	if (!res->palette)
+		res->palette = palette;
+	res->ncolors = ncolors;
+
+	return 0;
+
+fnerror:
+	free(hash);
+	free(palette);
+	free(pixels);
+	return -1;
+}
+
+/*
+ *
+ * Load png-image @filename and store it in @res.
+ *
+ * The image is kept as a palette of 0x00RRGGBB words plus one index per pixel,
+ * which is looked up while drawing the resource (see render_resource()).
+ *
+ */
+int load_resource(struct resource_st *res, const char *filename)
+{
+	unsigned int *pixels;
 
-		for (y=0;y<height;y++)
-			for (x=0;x<stop * 3;x++)
-				res->bytes[y][x] = subimage[y][x];
 
-		for (y=0;y<height;y++)
-			free(subimage[y]);
-		free(subimage);
-		width = stop;
+	pixels = decode_png(filename, &res->width, &res->height);
+	if (!pixels)
+		return -1;
+
+	res->stride = res->width;
+	return index_resource(res, pixels, res->width * res->height);
+}
+
+/*
+ *
+ * Make the @n consecutive resources at @res point to the sprites of @sheet,
+ * a sheet of @n sprites of @width pixels laid out side by side. The sheet is
+ * kept as a whole, so that each resource is just a rectangle of the atlas
+ * sharing its palette.
+ *
+ */
+void split_atlas(struct resource_st *res, struct resource_st *sheet, unsigned n, unsigned width)
+{
+	unsigned i;
+
+
+	// only the image is set, as the resources may be in use meanwhile
+	for (i=0;i<n && i*width<sheet->width;i++) {
+		res[i].indices = (char *)sheet->indices + i * width * sheet->isize;
+		res[i].isize = sheet->isize;
+		res[i].palette = sheet->palette;
+		res[i].ncolors = sheet->ncolors;
+		res[i].stride = sheet->stride;
+		res[i].width = (i + 1) * width > sheet->width ? sheet->width - i * width : width;
+		res[i].height = sheet->height;
 	}
+}
 
-	dllst = dllst_initlst(dllst, "I:");
-	for (y=0;y<height;y++) {
-		for (x=0;x<width * 3;x+=3) {
-			fields2.color = (res->bytes[y][x + 2] <<  0)|
-					(res->bytes[y][x + 1] <<  8)|
-					(res->bytes[y][x + 0] << 16);
-			if (!dllst_isinlst(dllst, &fields2))
-				dllst_newitem(dllst, &fields2);
-		}
+/*
+ *
+ * Load the png-image of @job into its resource, or into its atlas and the 13
+ * cards pointing to it. The image is used right from the cache file if the
+ * latter holds it as the png-file is now; otherwise, it is decoded and
+ * recorded so that the cache file is rebuilt on exit (see save_cache()). The
+ * path is built here, since res_path() is not meant to be called from
+ * several threads.
+ *
+ */
+void run_load(struct load_st *job)
+{
+	struct resource_st *res = job->suit == -1 ? &resource[job->res] : &card_atlas[job->suit];
+	char path[PATH_MAX];
+
+
+	snprintf(path, sizeof(path), "%s/%s", resdir, job->name);
+	if (!rescache_lookup(path, &job->image)) {
+		res->indices = (void *)job->image.indices;
+		res->isize = job->image.isize;
+		res->palette = (unsigned int *)job->image.palette;
+		res->ncolors = job->image.ncolors;
+		res->width = job->image.width;
+		res->height = job->image.height;
+		res->stride = res->width;
+	} else {
+		if (load_resource(res, path))
+			return;
+		job->image.indices = res->indices;
+		job->image.isize = res->isize;
+		job->image.palette = res->palette;
+		job->image.ncolors = res->ncolors;
+		job->image.width = res->width;
+		job->image.height = res->height;
+		job->decoded = TRUE;
 	}
 
-	res->height = height;
-	res->width  = width;
-	res->ncolors = dllst->size;
-	res->color = (GC *)malloc(dllst->size * sizeof(GC));
-	if (!res->color) {
-		perror("malloc");
-		return -1;
+	if (job->suit != -1)
+		split_atlas(&resource[job->res], res, 13, CARD_WIDTH);
+}
+
+/*
+ *
+ * Rebuild the cache file if any image had to be decoded, once they are all
+ * loaded, so that the next launch finds them all there.
+ *
+ */
+void save_cache(void)
+{
+	rescache_image_t images[sizeof(load_job)/sizeof(load_job[0])];
+	boolean_t stale = FALSE;
+	unsigned i, n = 0;
+
+
+	for (i=0;i<sizeof(load_job)/sizeof(load_job[0]);i++) {
+		if (load_job[i].state != LOAD_DONE || !load_job[i].image.indices)
+			continue;
+		images[n++] = load_job[i].image;
+		if (load_job[i].decoded)
+			stale = TRUE;
 	}
 
-	for (x=0,iter=dllst->head;x<dllst->size;x++,iter=iter->next) {
-		res->color[x] = XCreateGC(display, window, 0, NULL);
-		XSetForeground(display, res->color[x], *((unsigned long *)iter->fields));
+	if (cachefile && stale)
+		rescache_save(cachefile, images, n);
+}
+
+/*
+ *
+ * Body of the threads which decode resources in the background: each one
+ * takes the first image nobody has started with, until there are none left.
+ *
+ */
+void *loader_thread(void *arg)
+{
+	unsigned i;
+
+
+	pthread_mutex_lock(&load_mutex);
+	for (i=0;i<sizeof(load_job)/sizeof(load_job[0]);i++) {
+		if (load_job[i].state != LOAD_PENDING)
+			continue;
+
+		__atomic_store_n(&load_job[i].state, LOAD_BUSY, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&load_mutex);
+		run_load(&load_job[i]);
+		pthread_mutex_lock(&load_mutex);
+		__atomic_store_n(&load_job[i].state, LOAD_DONE, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&load_cond);
 	}
+	pthread_mutex_unlock(&load_mutex);
 
-	while (dllst_delitem(dllst, 0)) {}
-	free(dllst);
-	dllst = NULL;
-	png_destroy_read_struct(&png_ptr, &png_infoptr, NULL);
+	return NULL;
+}
 
-	return 0;
+/*
+ *
+ * Start decoding the resources in the background with as many threads as
+ * processors, up to MAX_LOADERS, so that the window shows up at once. If no
+ * thread can be created, resources are decoded on first use only.
+ *
+ */
+void start_loading(void)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+
+	if (ncpus < 1)
+		ncpus = 1;
+	for (nloaders=0;nloaders<ncpus && nloaders<MAX_LOADERS;nloaders++)
+		if (pthread_create(&loader[nloaders], NULL, loader_thread, NULL))
+			break;
 }
 
 /*
  *
- * Render @res, a previously loaded png-image, at (@X, @Y) coordinates.
+ * Make sure that @res has been decoded before it is used: if no thread has
+ * started with it yet, it is decoded right here; otherwise, wait for the
+ * thread. Once it is, this costs a look-up and no locking.
  *
  */
-void render_resource(struct resource_st *res, int X, int Y)
+void wait_resource(struct resource_st *res)
 {
-	int i, j, x, t;
-	unsigned long color = 0;
-	XGCValues values;
-
-
-	for (i=0;i<res->height;i++) {
-		for (x=0,j=0;x<res->width;x++,j+=3) {
-			color = (res->bytes[i][j + 2] <<  0)|
-				(res->bytes[i][j + 1] <<  8)|
-				(res->bytes[i][j + 0] << 16);
-			for (t=0;t<res->ncolors;t++) {
-				XGetGCValues(display, res->color[t], GCForeground, &values);
-				if (color == values.foreground) {
-					XDrawPoint(display, window, res->color[t], X + x, Y + i);
-					break;
-				}
-			}
+	struct load_st *job = NULL;
+	int i, n = res - resource;
+
+
+	for (i=0;i<sizeof(load_job)/sizeof(load_job[0]);i++) {
+		if (n >= load_job[i].res && n < load_job[i].res + (load_job[i].suit == -1 ? 1 : 13)) {
+			job = &load_job[i];
+			break;
 		}
 	}
+	if (!job || __atomic_load_n(&job->state, __ATOMIC_ACQUIRE) == LOAD_DONE)
+		return;
+
+	pthread_mutex_lock(&load_mutex);
+	if (job->state == LOAD_PENDING) {
+		__atomic_store_n(&job->state, LOAD_BUSY, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&load_mutex);
+		run_load(job);
+		pthread_mutex_lock(&load_mutex);
+		__atomic_store_n(&job->state, LOAD_DONE, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&load_cond);
+	}
+	while (job->state != LOAD_DONE)
+		pthread_cond_wait(&load_cond, &load_mutex);
+	pthread_mutex_unlock(&load_mutex);
+}
+
+/*
+ *
+ * Wait for the threads decoding resources to finish, e.g., before freeing them.
+ *
+ */
+void finish_loading(void)
+{
+	while (nloaders)
+		pthread_join(loader[--nloaders], NULL);
+}
+
+/*
+ *
+ * Render @res, a png-image decoded in the background, at (@X, @Y) coordinates.
+ *
+ */
+void render_resource(struct resource_st *res, int X, int Y)
+{
+	long long bench_t0;
+
+
+	BENCH_START(bench_t0);
+	wait_resource(res);
+	render_blitindexed(frame, res->indices, res->isize, res->palette,
+			   res->stride, res->width, res->height, X, Y, &res->sprite);
+	BENCH_STOP(BENCH_RENDER_RESOURCE, bench_t0);
 }
 
 /*
@@ -753,7 +1095,7 @@ void init_hand(void)
 
 #if defined(HAVE_XML_LOGS)
 	if (!xml_inputfile) {
-		now = time(NULL);
+		now = rseed ? rseed : time(NULL);
 	} else {
 		// get the random seed attribute of the element 'hand'
 		do_xmlDocGetRootElement(current_node, xml_inputfile);
@@ -764,7 +1106,7 @@ void init_hand(void)
 		current_node = replay_get_next_matching_iter(current_node, "turn");
 	}
 #else
-	now = time(NULL);
+	now = rseed ? rseed : time(NULL);
 #endif
 	srand(now);
 
@@ -778,9 +1120,9 @@ void init_hand(void)
 	init_deck();
 	init_players(NPLAYERS);
 
-	do_timer_unset(deck_timer);
-	do_timer_unset(playing_timer);
-	do_timer_unset(table_timer);
+	do_timer_unset(&deck_timer);
+	do_timer_unset(&playing_timer);
+	do_timer_unset(&table_timer);
 
 	played_list = dllst_initlst(played_list, "I:I:");
 	fields.suit   = CARD_SUIT(deck_list->head);
@@ -796,8 +1138,10 @@ void init_hand(void)
 #if defined(HAVE_XML_LOGS)
 	if (xml_inputfile) {
 		savelog = FALSE;
-		do_exposure(&event.xexpose);
+		do_exposure(NULL);
+		set_turbo(TRUE);
 		replay_hand(current_node);
+		set_turbo(FALSE);
 		return;
 	}
 #endif
@@ -817,10 +1161,11 @@ void init_hand(void)
  * As of v0.3.1, the denominator is no longer a constant value for number and
  * suit quotients. Instead, it now represents the amount of cards which neither
  * belong to the @n bot nor to the stack of played cards, that is, the total
- * number of cards of other players.
+ * number of cards of other players. The number of those cards of each
+ * number/suit is also stored at @unseen, unless it is NULL.
  *
  */
-void bot_calc_probabilities(int n)
+void bot_calc_probabilities(int n, unsigned *unseen)
 {
 	int i;
 	unsigned counter[17];
@@ -845,8 +1190,11 @@ void bot_calc_probabilities(int n)
 	}
 
 	// probabilities for the 13 numbers (ace up to king)
-	for (i=0;i<13;i++)
+	for (i=0;i<13;i++) {
 		player[n].probabilities[i] = (float)counter[i] / total;
+		if (unseen)
+			unseen[i] = counter[i];
+	}
 
 	for (i=0;i<4;i++) {
 		for (iter=player[n].list->head;iter;iter=iter->next)
@@ -858,8 +1206,11 @@ void bot_calc_probabilities(int n)
 	}
 
 	// probabilities for the 4 suits
-	for (i=13;i<17;i++)
+	for (i=13;i<17;i++) {
 		player[n].probabilities[i] = (float)counter[i] / total;
+		if (unseen)
+			unseen[i] = counter[i];
+	}
 }
 
 /*
@@ -883,7 +1234,7 @@ void add_selector(struct resource_st *card, int x, int dx, int y)
 	selpoints[1].y = y - 5;
 	selpoints[2].x = x;
 	selpoints[2].y = y;
-	XFillPolygon(display, window, gc_selector, selpoints, 3, Complex, CoordModeOrigin);
+	render_polygon(frame, COLOR_SELECTOR, selpoints, 3);
 }
 
 /*
@@ -907,64 +1258,86 @@ void del_selector(struct resource_st *card, int x, int dx, int y)
 	selpoints[1].y = y - 5;
 	selpoints[2].x = x;
 	selpoints[2].y = y;
-	XFillPolygon(display, window, gc_table, selpoints, 3, Complex, CoordModeOrigin);
+	render_polygon(frame, COLOR_TABLE, selpoints, 3);
 }
 
 /*
  *
- * Update cards of @nplayer according to action @act and optional argument @param.
- * Valid values for @act are ADD_CARD, DELETE_CARD and GET_CARD, for add, delete or
- * get cards from the deck, respectively. Selectors are meaningless for bots.
+ * Compute where card @i of @nplayer is drawn while the player holds @ncards cards.
+ * Both update_cards() and animate_card() rely on this layout.
  *
  */
-void update_cards(int nplayer, action_t act, void *param)
+void card_position(int nplayer, int ncards, int i, struct slot_st *slot)
 {
-	int i, xstart;
-	float sep;
-	dllst_item_struct_t *iter;
+	int sep;
 
 
 	if (nplayer == HUMAN || nplayer == BOT_2) {
-		if (player[nplayer].list->size > 5) {
-			sep = (CARD_WIDTH + 7) * 5 / player[nplayer].list->size;
-			xstart = (800 - 400) / 2;
+		if (ncards > 5) {
+			sep = (CARD_WIDTH + 7) * 5 / ncards;
+			slot->x = (800 - 400) / 2 + i * sep;
 		} else {
 			sep = CARD_WIDTH + 7;
-			xstart = (800 - player[nplayer].list->size * (CARD_WIDTH + 7)) / 2;
+			slot->x = (800 - ncards * (CARD_WIDTH + 7)) / 2 + i * sep;
 		}
+		slot->y = card_row[nplayer];
 
-		for (i=0,iter=player[nplayer].list->head;iter;iter=iter->next,i++) {
-			XFillRectangle(display, window, gc_table,
-				       i * sep + xstart, card_row[nplayer], CARD_WIDTH, CARD_HEIGHT);
-			if (nplayer == HUMAN) {
-				if (!iter->next) {
-					del_selector(&resource[CARD_SUIT(iter) * 13 + CARD_NUMBER(iter)],
-						     i * sep + xstart + CARD_WIDTH / 2,
-						     CARD_WIDTH / 2,
-						     card_row[HUMAN]);
-				} else {
-					del_selector(&resource[CARD_SUIT(iter) * 13 + CARD_NUMBER(iter)],
-						     i * sep + xstart + sep / 2,
-						     sep / 2,
-						     card_row[HUMAN]);
-				}
-			}
-		}
+		// the last card of the row is not covered by any other one
+		slot->dx = i < ncards - 1 ? sep / 2 : CARD_WIDTH / 2;
 	} else {
-		if (nplayer == BOT_1)
-			xstart = 10;
+		if (ncards > 5)
+			sep = (600 - 5 * 60) / ncards;
 		else
-			xstart = 800 - CARD_WIDTH - 10;
-
-		if (player[nplayer].list->size > 5) {
-			sep  = (600 - 5 * 60) / player[nplayer].list->size;
-		} else {
 			sep = (600 - 5 * (CARD_HEIGHT + 3)) / 2;
-		}
 
-		for (i=0;i<player[nplayer].list->size;i++)
-			XFillRectangle(display, window, gc_table, xstart, i * sep + 150, CARD_WIDTH, CARD_HEIGHT);
+		slot->x = nplayer == BOT_1 ? 10 : 800 - CARD_WIDTH - 10;
+		slot->y = 150 + i * sep;
+		slot->dx = CARD_WIDTH / 2;
 	}
+}
+
+/*
+ *
+ * Tell whether the human player may play the card at @iter, given the action @act
+ * which led to update the hand: after getting cards from the deck, only twos and
+ * aces can be played.
+ *
+ */
+boolean_t card_selectable(dllst_item_struct_t *iter, action_t act)
+{
+	if (act == GET_CARD)
+		return CARD_NUMBER(iter) == CARD_TWO(SUIT_CLUBS)    ||
+		       CARD_NUMBER(iter) == CARD_TWO(SUIT_DIAMONDS) ||
+		       CARD_NUMBER(iter) == CARD_TWO(SUIT_HEARTS)   ||
+		       CARD_NUMBER(iter) == CARD_TWO(SUIT_SPADES)   ||
+		       CARD_NUMBER(iter) == CARD_ACE(SUIT_CLUBS)    ||
+		       CARD_NUMBER(iter) == CARD_ACE(SUIT_DIAMONDS) ||
+		       CARD_NUMBER(iter) == CARD_ACE(SUIT_HEARTS)   ||
+		       CARD_NUMBER(iter) == CARD_ACE(SUIT_SPADES);
+
+	return CARD_SUIT(iter) == lastsuit || CARD_NUMBER(iter) == CARD_NUMBER(played_list->tail);
+}
+
+/*
+ *
+ * Update cards of @nplayer according to action @act and optional argument @param.
+ * Valid values for @act are ADD_CARD, DELETE_CARD and GET_CARD, for add, delete or
+ * get cards from the deck, respectively. Selectors are meaningless for bots.
+ *
+ * The hand is laid out again and compared against the layout it was last drawn
+ * with: cards are drawn from the first slot which changed on, since each card
+ * covers part of the previous one, and only selectors which changed are redrawn.
+ *
+ */
+void update_cards(int nplayer, action_t act, void *param)
+{
+	struct layout_st *old = &layout[nplayer];
+	struct slot_st slot[MAX_HAND], *sl;
+	dllst_item_struct_t *iter;
+	int i, n, first, x0, y0, x1, y1;
+	int erased_x0 = 800, erased_x1 = -1;
+	long long bench_t0, hud_t0;
+
 
 	switch (act) {
 	case DELETE_CARD:
@@ -975,94 +1348,74 @@ void update_cards(int nplayer, action_t act, void *param)
 		break;
 	};
 
-	if (nplayer == HUMAN || nplayer == BOT_2) {
-		if (player[nplayer].list->size > 5) {
-			sep = (CARD_WIDTH + 7) * 5 / player[nplayer].list->size;
-			xstart = (800 - 400) / 2;
-		} else {
-			sep = CARD_WIDTH + 7;
-			xstart = (800 - player[nplayer].list->size * (CARD_WIDTH + 7)) / 2;
-		}
+	// the layout still matches what is drawn, so that set_turbo() can
+	// redraw only what changed meanwhile
+	if (turbo)
+		return;
 
-		for (i=0,iter=player[nplayer].list->head;iter;iter=iter->next,i++) {
-			if (nplayer == HUMAN) {
-				render_resource(&resource[CARD_SUIT(iter) * 13 + CARD_NUMBER(iter)],
-					    i * sep + xstart, card_row[nplayer]);
-			} else {
-				if (show_bot_cards)
-					render_resource(&resource[CARD_SUIT(iter) * 13 + CARD_NUMBER(iter)],
-						    i * sep + xstart, card_row[nplayer]);
-				else
-					render_resource(&resource[RES_DECK], i * sep + xstart, card_row[nplayer]);
-			}
-			if (nplayer == HUMAN) {
-				if (act == GET_CARD) {
-					if (CARD_NUMBER(iter) == CARD_TWO(SUIT_CLUBS)    ||
-					    CARD_NUMBER(iter) == CARD_TWO(SUIT_DIAMONDS) ||
-					    CARD_NUMBER(iter) == CARD_TWO(SUIT_HEARTS)   ||
-					    CARD_NUMBER(iter) == CARD_TWO(SUIT_SPADES)   ||
-					    CARD_NUMBER(iter) == CARD_ACE(SUIT_CLUBS)    ||
-					    CARD_NUMBER(iter) == CARD_ACE(SUIT_DIAMONDS) ||
-					    CARD_NUMBER(iter) == CARD_ACE(SUIT_HEARTS)   ||
-					    CARD_NUMBER(iter) == CARD_ACE(SUIT_SPADES)) {
-						if (!iter->next) {
-							add_selector(&resource[CARD_SUIT(iter) * 13 + CARD_NUMBER(iter)],
-								     i * sep + xstart + CARD_WIDTH / 2,
-								     CARD_WIDTH / 2,
-								     card_row[HUMAN]);
-						} else {
-							add_selector(&resource[CARD_SUIT(iter) * 13 + CARD_NUMBER(iter)],
-								     i * sep + xstart + sep / 2,
-								     sep / 2,
-								     card_row[HUMAN]);
-						}
-					}
-					continue;
-				}
+	BENCH_START(bench_t0);
+	HUD_START(hud_t0);
 
-				if (CARD_SUIT(iter) == lastsuit ||
-				    CARD_NUMBER(iter) == CARD_NUMBER(played_list->tail)) {
-					if (!iter->next) {
-
-						/*
-						 * This is the last card of the list. We add a slightly modified
-						 * selector to allow to the user select this card from
-						 * (x - CARD_WIDTH / 2) <= mouse_x <= (x + CARD_WIDTH / 2)
-						 */
-						add_selector(&resource[CARD_SUIT(iter) * 13 + CARD_NUMBER(iter)],
-							     i * sep + xstart + CARD_WIDTH / 2,
-							     CARD_WIDTH / 2,
-							     card_row[HUMAN]);
-					} else {
-						add_selector(&resource[CARD_SUIT(iter) * 13 + CARD_NUMBER(iter)],
-							     i * sep + xstart + sep / 2,
-							     sep / 2,
-							     card_row[HUMAN]);
-					}
-				}
-			}
-		}
-	} else {
-		if (nplayer == BOT_1)
-			xstart = 10;
-		else
-			xstart = 800 - CARD_WIDTH - 10;
+	for (n=0,iter=player[nplayer].list->head;iter && n<MAX_HAND;iter=iter->next,n++) {
+		sl = &slot[n];
+		card_position(nplayer, player[nplayer].list->size, n, sl);
+		sl->card = CARD_SUIT(iter) * 13 + CARD_NUMBER(iter);
+		sl->res = nplayer == HUMAN || show_bot_cards ? sl->card : RES_DECK;
+		sl->selectable = nplayer == HUMAN && card_selectable(iter, act);
+	}
 
-		if (player[nplayer].list->size > 5) {
-			sep  = (600 - 5 * 60) / player[nplayer].list->size;
-		} else {
-			sep = (600 - 5 * (CARD_HEIGHT + 3)) / 2;
-		}
+	for (first=0;first<n && first<old->ncards;first++)
+		if (slot[first].x != old->slot[first].x ||
+		    slot[first].y != old->slot[first].y ||
+		    slot[first].res != old->slot[first].res)
+			break;
 
-		if (!show_bot_cards) {
-			for (i=0;i<player[nplayer].list->size;i++)
-				render_resource(&resource[RES_DECK], xstart, i * sep + 150);
-		} else {
-			for (i=0,iter=player[nplayer].list->head;iter;iter=iter->next,i++)
-				render_resource(&resource[CARD_SUIT(iter) * 13 + CARD_NUMBER(iter)],
-					    xstart, i * sep + 150);
+	// paint the table over the cards which are no longer where they were, and
+	// over the previous cards which stick out under them
+	if (first < old->ncards) {
+		x0 = old->slot[first].x;
+		y0 = old->slot[first].y;
+		x1 = old->slot[old->ncards - 1].x + CARD_WIDTH;
+		y1 = old->slot[old->ncards - 1].y + CARD_HEIGHT;
+		render_fill(frame, COLOR_TABLE, x0, y0, x1 - x0, y1 - y0);
+
+		while (first > 0 &&
+		       old->slot[first - 1].x + CARD_WIDTH > x0 &&
+		       old->slot[first - 1].y + CARD_HEIGHT > y0)
+			first--;
+	}
+
+	for (i=first;i<n;i++)
+		render_resource(&resource[slot[i].res], slot[i].x, slot[i].y);
+
+	// selectors of neighbour cards may overlap, so those erased are tracked
+	// in order to restore the ones they could have covered
+	for (i=0;i<old->ncards;i++) {
+		sl = &old->slot[i];
+		if (sl->selectable &&
+		    (i >= n || !slot[i].selectable || slot[i].card != sl->card ||
+		     slot[i].x + slot[i].dx != sl->x + sl->dx || slot[i].dx != sl->dx)) {
+			del_selector(&resource[sl->card], sl->x + sl->dx, sl->dx, sl->y);
+			if (sl->x + sl->dx < erased_x0)
+				erased_x0 = sl->x + sl->dx;
+			if (sl->x + sl->dx > erased_x1)
+				erased_x1 = sl->x + sl->dx;
 		}
 	}
+
+	for (i=0;i<n;i++) {
+		sl = &slot[i];
+		if (sl->selectable &&
+		    (i >= old->ncards || !old->slot[i].selectable || old->slot[i].card != sl->card ||
+		     old->slot[i].x + old->slot[i].dx != sl->x + sl->dx || old->slot[i].dx != sl->dx ||
+		     (sl->x + sl->dx > erased_x0 - 10 && sl->x + sl->dx < erased_x1 + 10)))
+			add_selector(&resource[sl->card], sl->x + sl->dx, sl->dx, sl->y);
+	}
+
+	memcpy(old->slot, slot, n * sizeof(struct slot_st));
+	old->ncards = n;
+	BENCH_STOP(BENCH_UPDATE_CARDS, bench_t0);
+	HUD_DRAWN(hud_t0);
 }
 
 /*
@@ -1084,12 +1437,13 @@ void update_table(action_table_t act)
 				render_resource(&resource[RES_SUIT_BASE + i], SUIT_X, SUIT_Y(i));
 	} else if (act == SELECT_SUIT) {
 		for (i=0;i<4;i++) {
+			wait_resource(&resource[RES_SUIT_BASE + i]);
 			resource[RES_SUIT_BASE + i].region.x0 = SUIT_X;
 			resource[RES_SUIT_BASE + i].region.y0 = SUIT_Y(i);
 			resource[RES_SUIT_BASE + i].region.x1 = SUIT_X + resource[RES_SUIT_BASE + i].width;
 			resource[RES_SUIT_BASE + i].region.y1 = SUIT_Y(i) + resource[RES_SUIT_BASE + i].height;
 		}
-		do_timer_set(table_timer, 0, 125000000);
+		do_timer_set(&table_timer, 0, 125000000);
 	} else if (act == SELECT_NONE) {
 		for (i=0;i<4;i++) {
 			resource[RES_SUIT_BASE + i].region.x0 = -1;
@@ -1097,7 +1451,7 @@ void update_table(action_table_t act)
 			resource[RES_SUIT_BASE + i].region.x1 = -1;
 			resource[RES_SUIT_BASE + i].region.y1 = -1;
 		}
-		do_timer_unset(table_timer);
+		do_timer_unset(&table_timer);
 	}
 }
 
@@ -1218,118 +1572,131 @@ char *decode_card(int suit, int number, boolean_t addnode)
  * the deck or plays the card of suit @suit and number @number. In the latter
  * case, @isplaying must be supplied as TRUE.
  *
+ * Positions are computed from the time elapsed since the move started, with
+ * an ease-in-out curve, so that every move lasts ANIM_DURATION no matter how
+ * fast the machine and the X server are. Frames are scheduled every
+ * FRAME_TIME * skipframes microseconds; when drawing falls behind, missed
+ * frames are dropped rather than delayed.
+ *
+ * If the backend can move the card by itself (e.g., through XRender), the
+ * card is uploaded once and the back buffer is not touched; otherwise, or
+ * while it passes under the HUD, what the card covers is saved and restored
+ * on each frame.
+ *
  */
 void animate_card(int nplayer, boolean_t isplaying, int suit, int number)
 {
-	int i, t, x, y, incr, obj_x = 0, obj_y = 0, start;
-	int dst_x, dst_y, bound;
-	boolean_t (*less_or_greater)(int, int);
-	float slope, sep;
-	dllst_item_struct_t *iter = NULL;
-
-
-	if (nplayer == HUMAN || nplayer == BOT_2) {
-		if (player[nplayer].list->size > 5) {
-			sep = (CARD_WIDTH + 7) * 5 / player[nplayer].list->size;
-			start = (800 - 400) / 2;
-		} else {
-			sep = CARD_WIDTH + 7;
-			start = (800 - player[nplayer].list->size * (CARD_WIDTH + 7)) / 2;
-		}
-	} else {
-		if (nplayer == BOT_1)
-			start = 10;
-		else
-			start = 800 - CARD_WIDTH - 10;
+	int i, x, y, obj_x = 0, obj_y = 0;
+	int src_x, src_y, dst_x, dst_y;
+	long long t0, now, next;
+	float t;
+	struct slot_st dst;
+	struct resource_st *res;
+	unsigned int *pixels = NULL;
+	unsigned pw, ph;
+	boolean_t moving;
+	long long bench_t0, hud_t0, hud_frame;
+
+
+	if (turbo)
+		return;
 
-		if (player[nplayer].list->size > 5)
-			sep = (600 - 5 * 60) / player[nplayer].list->size;
-		else
-			sep = (600 - 5 * (CARD_HEIGHT + 3)) / 2;
-	}
+	BENCH_START(bench_t0);
+	HUD_START(hud_t0);
 
 	if (!isplaying) {
-		if (nplayer == HUMAN || nplayer == BOT_2) {
-			obj_x = start + player[nplayer].list->size * sep;
-			obj_y = nplayer == HUMAN ? card_row[HUMAN] : card_row[BOT_2];
-		} else {
-			obj_x = start;
-			obj_y = 150 + player[nplayer].list->size * sep;
-		}
+		// the card goes right after the last one of the hand as it is drawn now
+		card_position(nplayer, layout[nplayer].ncards, layout[nplayer].ncards, &dst);
+		obj_x = dst.x;
+		obj_y = dst.y;
 	} else {
-		for (i=0,iter=player[nplayer].list->head;iter;iter=iter->next,i++) {
-			if (CARD_SUIT(iter) == suit && CARD_NUMBER(iter) == number) {
-				if (nplayer == HUMAN || nplayer == BOT_2) {
-					obj_x = start + i * sep;
-					obj_y = nplayer == HUMAN ? card_row[HUMAN] : card_row[BOT_2];
-				} else {
-					obj_x = start;
-					obj_y = 150 + i * sep;
-				}
-
+		for (i=0;i<layout[nplayer].ncards;i++) {
+			if (layout[nplayer].slot[i].card == suit * 13 + number) {
+				obj_x = layout[nplayer].slot[i].x;
+				obj_y = layout[nplayer].slot[i].y;
 				break;
 			}
 		}
 	}
 
 	if (!isplaying) {
-		dst_x = DECK_X;
-		dst_y = DECK_Y;
+		res = &resource[RES_DECK];
+		src_x = DECK_X;
+		src_y = DECK_Y;
+		dst_x = obj_x;
+		dst_y = obj_y;
 	} else {
+		res = &resource[suit * 13 + number];
+		src_x = obj_x;
+		src_y = obj_y;
 		dst_x = STACK_OF_PLAYED_X;
 		dst_y = STACK_OF_PLAYED_Y;
 	}
 
-	if (obj_x != dst_x) {
-		slope = (float)(obj_y - dst_y) / (float)(obj_x - dst_x);
-		incr = obj_x > dst_x ? 1 : -1;
-		if (dst_x == STACK_OF_PLAYED_X)
-			incr *= (-1);
-		less_or_greater = incr == 1 ? fn_less : fn_greater;
-		bound = dst_x == DECK_X ? (obj_x - dst_x) : (dst_x - obj_x);
-		if (dst_x != DECK_X) {
-			t = dst_x;
-			dst_x = obj_x;
-			obj_x = t;
-			t = dst_y;
-			dst_y = obj_y;
-			obj_y = t;
-		}
-		for (x=0;less_or_greater(x, bound);x+=incr * skipframes) {
-			XCopyArea(display, window, cardpixmap, gc_white,
-				  dst_x + x, dst_y + slope * x, CARD_WIDTH, CARD_HEIGHT, 0, 0);
-			if (!isplaying)
-				render_resource(&resource[RES_DECK], dst_x + x, dst_y + slope * x);
-			else
-				render_resource(&resource[suit * 13 + number], dst_x + x, dst_y + slope * x);
-			XCopyArea(display, cardpixmap, window, gc_white,
-				  0, 0, CARD_WIDTH, CARD_HEIGHT, dst_x + x, dst_y + slope * x);
-		}
-	} else {
-		incr = obj_y > dst_y ? 1 : -1;
-		if (dst_y == STACK_OF_PLAYED_Y)
-			incr *= (-1);
-		less_or_greater = incr == 1 ? fn_less : fn_greater;
-		bound = dst_y == DECK_Y ? (obj_y - dst_y) : (dst_y - obj_y);
-		if (dst_y != DECK_X) {
-			t = dst_y;
-			dst_y = obj_y;
-			obj_y = t;
-			t = dst_x;
-			dst_x = obj_x;
-			obj_x = t;
-		}
-		for (y=0;less_or_greater(y, bound);y+=incr * skipframes) {
-			XCopyArea(display, window, cardpixmap, gc_white,
-				  dst_x, dst_y + y, CARD_WIDTH, CARD_HEIGHT, 0, 0);
-			if (!isplaying)
-				render_resource(&resource[RES_DECK], dst_x, dst_y + y);
-			else
-				render_resource(&resource[suit * 13 + number], dst_x, dst_y + y);
-			XCopyArea(display, cardpixmap, window, gc_white,
-				  0, 0, CARD_WIDTH, CARD_HEIGHT, dst_x, dst_y + y);
+	render_flush(frame);
+	wait_resource(res);
+	moving = frame->backend->sprite &&
+		 !render_loadsprite(frame, res->indices, res->isize, res->palette, res->stride,
+				    res->width, res->height, &res->sprite) &&
+		 !render_movesprite(frame, &res->sprite, src_x, src_y) ? TRUE : FALSE;
+	// what the card covers is saved at the resolution of the window, also
+	// when it is moved by the server, in case it has to pass under the HUD
+	pw = render_scaled(frame, CARD_WIDTH);
+	ph = render_scaled(frame, CARD_HEIGHT);
+	pixels = (unsigned int *)calloc(pw * ph, sizeof(unsigned int));
+	if (!pixels) {
+		if (moving)
+			render_movesprite(frame, NULL, 0, 0);
+		return;
+	}
+
+	t0 = next = get_time_usecs();
+	while ((now = get_time_usecs()) - t0 < ANIM_DURATION) {
+		t = (float)(now - t0) / ANIM_DURATION;
+		t = t < 0.5 ? 2 * t * t : 1 - 2 * (1 - t) * (1 - t);
+		x = src_x + (dst_x - src_x) * t;
+		y = src_y + (dst_y - src_y) * t;
+
+		HUD_START(hud_frame);
+		if (!moving || render_movesprite(frame, &res->sprite, x, y)) {
+			// only the footprint of the card is saved and restored
+			render_read(frame, pixels, x, y, pw, ph);
+			render_resource(res, x, y);
+			render_flush(frame);
+			render_blit(frame, pixels, pw, ph, x, y);
 		}
+		HUD_STOP(HUD_ANIMATE_FRAME, hud_frame);
+
+		do {
+			next += FRAME_TIME * skipframes;
+		} while (next <= get_time_usecs());
+		sleep_until_usecs(next);
 	}
+	if (moving)
+		render_movesprite(frame, NULL, 0, 0);
+	free(pixels);
+	BENCH_STOP(BENCH_ANIMATE_CARD, bench_t0);
+	HUD_DRAWN(hud_t0);
+}
+
+/*
+ *
+ * Enable or disable the turbo mode, in which cards are neither animated nor drawn
+ * in the hands, so that bots can play a long stretch of turns, or a hand can be
+ * replayed, in no time. Once disabled, the hands are drawn as they ended up.
+ *
+ */
+void set_turbo(boolean_t enable)
+{
+	int i;
+
+
+	turbo = enable;
+	if (turbo)
+		return;
+
+	for (i=0;i<NPLAYERS;i++)
+		update_cards(i, EXPOSURE_CARD, NULL);
 }
 
 /*
@@ -1357,7 +1724,7 @@ getcard:
 
 		return fields.suit * 13 + fields.number;
 	} else {
-		do_timer_set(deck_timer, 0, 62500000);
+		do_timer_set(&deck_timer, 0, 62500000);
 		while (played_list->size > 1) {
 			fields.suit   = CARD_SUIT(played_list->head);
 			fields.number = CARD_NUMBER(played_list->head);
@@ -1434,6 +1801,23 @@ void playcard(int n, int suit, int number, unsigned long *param)
 	decode_card(suit, number, TRUE);
 }
 
+/*
+ *
+ * Play the turn of the bot @n. How long it thinks is sampled for the HUD,
+ * leaving out the time spent drawing and moving cards.
+ *
+ */
+void bot_play(int n)
+{
+	long long t0, drawn = hud_drawing;
+
+
+	HUD_START(t0);
+	bot_turn(n);
+	if (hud_enabled)
+		hud_sample(HUD_BOT_THINK, bench_time_nsecs() - t0 - (hud_drawing - drawn));
+}
+
 /*
  *
  * Main function of bots game.
@@ -1444,11 +1828,11 @@ void playcard(int n, int suit, int number, unsigned long *param)
  */
 #define THIS_CARD(x)	table->names[*((unsigned *)x->fields + t * 2)]
 #define LAST_CARD(x)	table->names[*((unsigned *)x->fields + (paths->fields_no - 1) * 2)]
-void bot_play(int n)
+void bot_turn(int n)
 {
 	long i = 0, j, t, id, min, moves = 0, xcard;
 	int ret_suit, ret_number;
-	unsigned cond_row;
+	unsigned cond_row, unseen[17];
 	dllst_item_struct_t *iter, *iter2;
 	boolean_t cpuplayed = FALSE, match = FALSE;
 	dllst_t *alternatives = NULL, *paths = NULL, *conds = NULL, *prob = NULL;
@@ -1458,7 +1842,7 @@ void bot_play(int n)
 	struct {
 		unsigned num;
 		int unused0;
-		float prb;
+		unsigned cnt;
 		int unused1;
 	} prob_fields = { 0 };
 
@@ -1525,7 +1909,7 @@ void bot_play(int n)
 		for (j=table->dim;j>0;j--) {
 			paths = digraph_get_paths(table, j, conds);
 			if (!paths->size) {
-				while (dllst_delitem(paths, 0)) {}
+				dllst_clear(paths);
 				free(paths);
 				paths = NULL;
 
@@ -1564,11 +1948,14 @@ void bot_play(int n)
 			 * which turns bots smarter.
 			 *
 			 */
-			bot_calc_probabilities(n);
-			prob = dllst_initlst(prob, "I:f:");
+			bot_calc_probabilities(n, unseen);
+			// probabilities share their denominator, so sorting by the number of
+			// unseen cards, which is 13 at most, gives the same order in linear time
+			prob = dllst_initlst(prob, "I:I:");
+			dllst_setrange(prob, 1, 0, 13);
 			for (t=0;t<17;t++) {
 				prob_fields.num = t;
-				prob_fields.prb = player[n].probabilities[t];
+				prob_fields.cnt = unseen[t];
 				dllst_newitem(prob, &prob_fields);
 			}
 			dllst_sortby(prob, 1, TRUE);
@@ -1614,7 +2001,7 @@ void bot_play(int n)
 					buf[1] = 'S';
 					break;
 				};
-				printf("%s: %f\n", buf, *((float *)iter->fields + 2));
+				printf("%s: %f\n", buf, player[n].probabilities[*((unsigned *)iter->fields + 0)]);
 				memset(buf, '\0', 64);
 			}
 #endif
@@ -1632,7 +2019,7 @@ void bot_play(int n)
 					break;
 			}
 
-			while (dllst_delitem(prob, 0)) {}
+			dllst_clear(prob);
 			free(prob);
 			prob = NULL;
 			if (!match)
@@ -1685,20 +2072,20 @@ void bot_play(int n)
 
 			// The player will subtract one point for each four cards played
 			player[n].specialpts -= moves / 4;
-			while (dllst_delitem(paths, 0)) {}
+			dllst_clear(paths);
 			free(paths);
 			paths = NULL;
 			break;
 		}
 		digraph_destroy_table(table);
-		while (dllst_delitem(conds, 0)) {}
+		dllst_clear(conds);
 		free(conds);
 		conds = NULL;
 		goto fnreturn;
 
 checkalternatives:
 		if (alternatives->size) {
-			bot_calc_probabilities(n);
+			bot_calc_probabilities(n, NULL);
 			min = CARD_SUIT(alternatives->head) * 13 + CARD_NUMBER(alternatives->head);
 			for (iter=alternatives->head->next;iter;iter=iter->next)
 				if (player[n].probabilities[CARD_SUIT(iter)] < player[n].probabilities[min / 13] ||
@@ -1725,7 +2112,7 @@ checkalternatives:
 				do_xmlNewChild(node, turn_node, "msg", message);
 			}
 
-			while (dllst_delitem(alternatives, 0)) {}
+			dllst_clear(alternatives);
 			free(alternatives);
 			alternatives = NULL;
 			cpuplayed = TRUE;
@@ -1742,7 +2129,7 @@ fnreturn:
 					finish_hand();
 			}
 			update_turn(FLAGS_NONE);
-			while (dllst_delitem(alternatives, 0)) {}
+			dllst_clear(alternatives);
 			free(alternatives);
 			return;
 		} else if (!i) {
@@ -1804,7 +2191,7 @@ getmorecards:
 	printf("\t%s\n", message);
 	do_xmlNewChild(node, turn_node, "msg", message);
 	update_turn(FLAGS_NONE);
-	while (dllst_delitem(alternatives, 0)) {}
+	dllst_clear(alternatives);
 	free(alternatives);
 	if (getactiveplayers() == 1)
 		finish_hand();
@@ -1848,8 +2235,8 @@ void finish_hand(void)
 		     CARD_WIDTH / 2,
 		     (600 - CARD_HEIGHT) / 2);
 
-	do_timer_unset(deck_timer);
-	dialog = gui_newdialog(display, window, "Table of scores",
+	do_timer_unset(&deck_timer);
+	dialog = gui_newdialog(frame, "Table of scores",
 			       (800 - 350) / 2,
 			       (600 - 240) / 2, 350, 240);
 	table = gui_table_new(dialog, 5, 4);
@@ -1883,25 +2270,44 @@ void finish_hand(void)
 
 	if (t == NPLAYERS) {
 		nhand++;
-		newhand_button = gui_addbutton(dialog, "New hand", 350 - 10 - 10 * FNT_WIDTH, 200);
+		gui_addbutton(dialog, "New hand", 350 - 10 - 10 * FNT_WIDTH, 200, BUTTON_NEWHAND);
 	} else {
 		nhand = 0;
 		ngame++;
 		sprintf(str, "%s lost", player[t].name);
 		gui_addlabel(dialog, str, 9);
-		newgame_button = gui_addbutton(dialog, "New game", 350 - 10 - 10 * FNT_WIDTH, 200);
+		gui_addbutton(dialog, "New game", 350 - 10 - 10 * FNT_WIDTH, 200, BUTTON_NEWGAME);
 	}
 	hand_finished = TRUE;
 }
 
+/*
+ *
+ * Redraw the area of the window exposed by @ep. Everything the window shows
+ * is kept in the back buffer, so it is enough to send the exposed rectangle
+ * again. If @ep is NULL, the whole table is composed from scratch, e.g., when
+ * a new hand starts.
+ *
+ */
 void do_exposure(XExposeEvent *ep)
 {
 	int i;
+	long long bench_t0;
 
 
-	XFillRectangle(display, window, gc_table, 0, 0, 800, 600);
+	if (ep) {
+		render_invalidate(frame, ep->x, ep->y, ep->width, ep->height);
+		return;
+	}
+
+	BENCH_START(bench_t0);
+	render_fill(frame, COLOR_TABLE, 0, 0, 800, 600);
 	unlock_deck();
 
+	// hands are painted over, they are drawn again from scratch
+	for (i=0;i<NPLAYERS;i++)
+		layout[i].ncards = 0;
+
 	fields.suit   = CARD_SUIT(played_list->tail);
 	fields.number = CARD_NUMBER(played_list->tail);
 	render_resource(&resource[fields.suit * 13 + fields.number], STACK_OF_PLAYED_X, STACK_OF_PLAYED_Y);
@@ -1911,11 +2317,20 @@ void do_exposure(XExposeEvent *ep)
 	update_cards(BOT_2, EXPOSURE_CARD, NULL);
 	update_cards(BOT_3, EXPOSURE_CARD, NULL);
 
-	XDrawImageString(display, window, gc_white, 200 - strlen(player[0].name) * 6, HUMAN_Y,
-			 player[0].name, strlen(player[0].name));
-	XDrawImageString(display, window, gc_white, BOT_1_X, BOT_1_Y, player[1].name, strlen(player[1].name));
-	XDrawImageString(display, window, gc_white, BOT_2_X, BOT_2_Y, player[2].name, strlen(player[2].name));
-	XDrawImageString(display, window, gc_white, BOT_3_X, BOT_3_Y, player[3].name, strlen(player[3].name));
+	draw_status();
+	BENCH_STOP(BENCH_DO_EXPOSURE, bench_t0);
+}
+
+/*
+ *
+ * Draw whose turn it is, the suit to follow, the direction of play and the
+ * names of the players.
+ *
+ */
+void draw_status(void)
+{
+	int i;
+
 
 	for (i=0;i<NPLAYERS;i++)
 		if (turn == i)
@@ -1929,6 +2344,91 @@ void do_exposure(XExposeEvent *ep)
 		render_resource(&resource[RES_ARROW_CW], ARROW_X, ARROW_Y);
 	else
 		render_resource(&resource[RES_ARROW_CCW], ARROW_X, ARROW_Y);
+
+	render_text(frame, COLOR_NAME, COLOR_TABLE, 200 - strlen(player[0].name) * 6, HUMAN_Y,
+		    player[0].name, strlen(player[0].name));
+	render_text(frame, COLOR_NAME, COLOR_TABLE, BOT_1_X, BOT_1_Y, player[1].name, strlen(player[1].name));
+	render_text(frame, COLOR_NAME, COLOR_TABLE, BOT_2_X, BOT_2_Y, player[2].name, strlen(player[2].name));
+	render_text(frame, COLOR_NAME, COLOR_TABLE, BOT_3_X, BOT_3_Y, player[3].name, strlen(player[3].name));
+}
+
+/*
+ *
+ * Draw the whole table again as it is, e.g., once the window has been resized.
+ * Unlike do_exposure(NULL), which starts a new hand, nothing changes: hands are
+ * drawn as they were laid out, selectors included, and so is the deck.
+ *
+ */
+void redraw_table(void)
+{
+	struct slot_st *sl;
+	int i, j;
+
+
+	// nothing is drawn until the first hand is dealt
+	if (!played_list)
+		return;
+
+	render_fill(frame, COLOR_TABLE, 0, 0, TABLE_WIDTH, TABLE_HEIGHT);
+	if (resource[RES_DECK_LOCKED].region.x0 == DECK_X) {
+		render_resource(&resource[RES_DECK_LOCKED], DECK_X, DECK_Y);
+	} else {
+		render_resource(&resource[RES_DECK], DECK_X, DECK_Y);
+		if (resource[RES_DECK].region.x0 != -1)
+			add_selector(&resource[RES_DECK], DECK_X + CARD_WIDTH / 2, CARD_WIDTH / 2, DECK_Y);
+	}
+
+	fields.suit   = CARD_SUIT(played_list->tail);
+	fields.number = CARD_NUMBER(played_list->tail);
+	render_resource(&resource[fields.suit * 13 + fields.number], STACK_OF_PLAYED_X, STACK_OF_PLAYED_Y);
+
+	for (i=0;i<NPLAYERS;i++) {
+		for (j=0;j<layout[i].ncards;j++) {
+			sl = &layout[i].slot[j];
+			render_resource(&resource[sl->res], sl->x, sl->y);
+		}
+		for (j=0;j<layout[i].ncards;j++) {
+			sl = &layout[i].slot[j];
+			if (sl->selectable)
+				add_selector(&resource[sl->card], sl->x + sl->dx, sl->dx, sl->y);
+		}
+	}
+
+	draw_status();
+}
+
+/*
+ *
+ * Scale the table, and the dialog if any, to the new size of the window,
+ * @width x @height pixels. Sprites are resampled the first time they are
+ * drawn at the new scale.
+ *
+ */
+void do_resize(unsigned width, unsigned height)
+{
+	if (width == frame->width && height == frame->height)
+		return;
+
+	if (render_resize(frame, width, height)) {
+		printf("Could not allocate the back buffer of the window\n");
+		exit(1);
+	}
+
+	redraw_table();
+	if (dialog)
+		gui_invalidate(dialog, dialog->x0, dialog->y0, dialog->x1 - dialog->x0, dialog->y1 - dialog->y0);
+	hud_redraw(frame);
+}
+
+/*
+ *
+ * Show or hide the HUD when KEY_HUD is pressed. Other keys are ignored.
+ *
+ */
+void do_keydown(XKeyEvent *kp)
+{
+	if (XLookupKeysym(kp, 0) == KEY_HUD)
+		hud_show(frame, !hud_enabled);
 }
 
 void do_buttondown(XButtonEvent *bp)
@@ -1941,25 +2441,27 @@ void do_buttondown(XButtonEvent *bp)
 	static boolean_t vlock = FALSE;
 	char message[128] = { '\0' };
 	int dispatched = 0;
+	gui_button_t *button;
+
 
+	// the table is laid out in its own coordinates, whatever the size of the window
+	render_unscale(frame, &bp->x, &bp->y);
 
 	if (hand_finished) {
-		if ((newhand_button && (bp->x > newhand_button->x0 && bp->x < newhand_button->x1 &&
-		                         bp->y > newhand_button->y0 && bp->y < newhand_button->y1)) ||
-		    (newgame_button && (bp->x > newgame_button->x0 && bp->x < newgame_button->x1 &&
-		                        bp->y > newgame_button->y0 && bp->y < newgame_button->y1))) {
+		button = gui_hittest(dialog, bp->x, bp->y);
+		if (button) {
 			if (vlock)
 				return;
 
 			vlock = TRUE;
-			while (dllst_delitem(played_list, 0)) {}
+			dllst_clear(played_list);
 			free(played_list);
 			played_list = NULL;
-			while (dllst_delitem(deck_list, 0)) {}
+			dllst_clear(deck_list);
 			free(deck_list);
 			deck_list = NULL;
 			for (i=0;i<NPLAYERS;i++) {
-				while (dllst_delitem(player[i].list, 0)) {}
+				dllst_clear(player[i].list);
 				free(player[i].list);
 				player[i].list = NULL;
 			}
@@ -1967,8 +2469,7 @@ void do_buttondown(XButtonEvent *bp)
 			for (i=0;i<52;i++)
 				del_selector(&resource[i], 0, 0, 0);
 
-			if (newgame_button && (bp->x > newgame_button->x0 && bp->x < newgame_button->x1 &&
-			                       bp->y > newgame_button->y0 && bp->y < newgame_button->y1)) {
+			if (button->id == BUTTON_NEWGAME) {
 				for (i=0;i<NPLAYERS;i++) {
 					player[i].scores = 0;
 					player[i].specialpts = 0;
@@ -1980,13 +2481,10 @@ void do_buttondown(XButtonEvent *bp)
 			}
 
 			hand_finished = FALSE;
-			free(newhand_button);
-			newhand_button = NULL;
-			free(newgame_button);
-			newgame_button = NULL;
 			gui_destroydialog(dialog);
+			dialog = NULL;
 			init_hand();
-			do_exposure(&event.xexpose);
+			do_exposure(NULL);
 			vlock = FALSE;
 		}
 	}
@@ -2076,7 +2574,7 @@ void do_buttondown(XButtonEvent *bp)
 							humanplayed = TRUE;
 						} else {
 							dispatched++;
-							do_timer_set(playing_timer, 0, 125000000);
+							do_timer_set(&playing_timer, 0, 125000000);
 						}
 
 						if (i == CARD_TWO(CARD_SUIT(iter)))
@@ -2107,8 +2605,8 @@ void do_buttondown(XButtonEvent *bp)
 				if (humanplayed) {
 					update_table(SELECT_NONE);
 					update_table(EXPOSURE_SUIT);
-					do_timer_unset(playing_timer);
-					do_timer_unset(table_timer);
+					do_timer_unset(&playing_timer);
+					do_timer_unset(&table_timer);
 
 					// @dispatched can be at most 17 (i.e., all of
 					// the 4s, 7s, jacks, queens and a arbitrary
@@ -2144,8 +2642,10 @@ void do_buttondown(XButtonEvent *bp)
 							do_xmlNewChild(node, turn_node, "msg", message);
 							player[HUMAN].active = FALSE;
 							update_turn(FLAGS_NONE);
+							set_turbo(TRUE);
 							while (getactiveplayers() > 1)
 								bot_play(turn);
+							set_turbo(FALSE);
 							finish_hand();
 						}
 					} else {
@@ -2174,8 +2674,8 @@ void do_buttondown(XButtonEvent *bp)
 				update_table(EXPOSURE_SUIT);
 				humanplayed = TRUE;
 				moves = 0;
-				do_timer_unset(playing_timer);
-				do_timer_unset(table_timer);
+				do_timer_unset(&playing_timer);
+				do_timer_unset(&table_timer);
 
 				sprintf(message, "I have no cards matching suit or number as last card played");
 				printf("\t%s\n", message);
@@ -2205,49 +2705,81 @@ void do_buttondown(XButtonEvent *bp)
 	};
 }
 
-void do_timer(union sigval tp)
+void do_timer(int arg)
 {
 	int j;
 	static int i = 0, suit = 0;
 	static unsigned long playing_status = 0;
 
 
-	if (tp.sival_int == 1) {
+	if (arg == 1) {
 
 		// deck_timer
-		XLockDisplay(display);
-		XFillRectangle(display, window, gc_anim[i & 7], DECK_X - 7, DECK_Y + i * 12, 3, 11);
+		render_fill(frame, color_anim[i & 7], DECK_X - 7, DECK_Y + i * 12, 3, 11);
 		if (++i > 7) {
 			i = 0;
-			do_timer_unset(deck_timer);
-			XFillRectangle(display, window, gc_table, DECK_X - 7, DECK_Y, 3, 8 * 12);
+			do_timer_unset(&deck_timer);
+			render_fill(frame, COLOR_TABLE, DECK_X - 7, DECK_Y, 3, 8 * 12);
 		}
-		XUnlockDisplay(display);
-	} else if (tp.sival_int == 2) {
+	} else if (arg == 2) {
 
 		// playing_timer
-		XLockDisplay(display);
 		if (playing_status & 1)
 			render_resource(&resource[RES_PLAYING_ENABLED], playing_x[turn], playing_y[turn]);
 		else
 			render_resource(&resource[RES_PLAYING_DISABLED], playing_x[turn], playing_y[turn]);
 
 		playing_status++;
-		XUnlockDisplay(display);
-	} else if (tp.sival_int == 3) {
+	} else if (arg == 3) {
 
 		// table_timer
-		XLockDisplay(display);
 		for (j=0;j<4;j++)
 			if ((suit & 3) == j)
 				render_resource(&resource[RES_SUIT_BASE_INV + j], SUIT_X, SUIT_Y(j));
 			else
 				render_resource(&resource[RES_SUIT_BASE + j], SUIT_X, SUIT_Y(j));
 		suit++;
-		XUnlockDisplay(display);
 	}
 }
 
+/*
+ *
+ * Let bots play a whole hand, the seat of the human included, and write to
+ * @filename how long the drawing routines took and how many requests were
+ * needed to send each frame. The hand is dealt with the seed given by
+ * --seed, or BENCH_SEED, and animations run on a simulated clock, so that
+ * every run draws exactly the same frames without waiting for them. With
+ * --offscreen, the final table is also written to a png-image.
+ * Return 0 on success, 1 otherwise.
+ *
+ */
+int bench_hand(const char *filename)
+{
+	unsigned turns;
+
+
+	if (!rseed)
+		rseed = BENCH_SEED;
+	set_virtual_clock(TRUE);
+	bench_enabled = TRUE;
+
+	init_hand();
+	do_exposure(NULL);
+	render_flush(frame);
+	bench_firstframe(frame);
+	for (turns=0;!hand_finished && turns<BENCH_MAX_TURNS;turns++) {
+		bot_play(turn);
+		gui_update(dialog);
+		render_flush(frame);
+	}
+
+	bench_enabled = FALSE;
+	if (offscreen && render_savepng(frame, offscreen))
+		return 1;
+
+	return bench_report(filename, frame, rseed, turns) ? 1 : 0;
+}
+
 /*
  *
  * Function registered as the last procedure to run on program exit.
@@ -2286,27 +2818,39 @@ void do_exit(void)
 	do_xmlFreeDoc(xml_logfile);
 	do_xmlCleanupParser();
 
-	while (dllst_delitem(deck_list, 0)) {}
+	dllst_clear(deck_list);
 	free(deck_list);
-	while (dllst_delitem(played_list, 0)) {}
+	dllst_clear(played_list);
 	free(played_list);
 	for (i=0;i<NPLAYERS;i++) {
-		while (dllst_delitem(player[i].list, 0)) {}
+		dllst_clear(player[i].list);
 		free(player[i].list);
 	}
-	for (i=0;i<NRESOURCES;i++) {
-		free(resource[i].bytes);
-		free(resource[i].color);
+	dllst_releasepool();
+	finish_loading();
+	save_cache();
+	for (i=0;i<4;i++) {
+		if (!rescache_owns(card_atlas[i].indices)) {
+			free(card_atlas[i].indices);
+			free(card_atlas[i].palette);
+		}
+	}
+	for (i=52;i<NRESOURCES;i++) {
+		if (!rescache_owns(resource[i].indices)) {
+			free(resource[i].indices);
+			free(resource[i].palette);
+		}
+	}
+	rescache_close();
+	free(cachefile);
+	for (i=0;i<NRESOURCES;i++)
+		render_freesprite(&resource[i].sprite);
+	hud_show(frame, FALSE);
+	render_destroyframe(frame);
+	if (display) {
+		XDestroyWindow(display, window);
+		XFlush(display);
+		XCloseDisplay(display);
 	}
-	XFreePixmap(display, cardpixmap);
-	XFreeGC(display, gc_white);
-	XFreeGC(display, gc_black);
-	XFreeGC(display, gc_table);
-	XFreeGC(display, gc_selector);
-	for (i=0;i<8;i++)
-		XFreeGC(display, gc_anim[i]);
-	XDestroyWindow(display, window);
-	XFlush(display);
-	XCloseDisplay(display);
 }
 
@@ -22,6 +22,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/timerfd.h>
 #include "dllst.h"
 #include "misc.h"
 
@@ -29,6 +32,8 @@
 #define SUIT_DIAMONDS           1
 #define SUIT_HEARTS             2
 #define SUIT_SPADES             3
+#define WHEEL_SLOTS		64
+#define WHEEL_TICK		15625000	// Nanoseconds per tick of the timer wheel (1/64 s)
 
 extern struct player_st {
         char name[20];
@@ -43,6 +48,12 @@ extern int game_total;
 extern int show_bot_cards;
 extern char *logfilename;
 
+static int wheel_fd = -1;
+static wheel_timer_t *wheel[WHEEL_SLOTS] = { NULL };
+static unsigned long long wheel_ticks = 0;
+static unsigned wheel_armed = 0;
+static long long virtual_usecs = -1;	// Simulated time, or -1 to read the clock
+
 /*
  *
  * Open the text file @filename and add labels to the dialog @dlg for each
@@ -100,83 +111,218 @@ void print_rules(gui_dialog_t *dlg, char *filename)
 
 /*
  *
- * Return TRUE if @var is less than or equal to @bound, FALSE otherwise.
- * fn_less() and fn_greater() are functions called as continuity condition of
- * loops which can iterate both positively and negatively. See main.c:animate_card()
- * for a use case.
+ * Stop reading the system clock and simulate it instead if @enable is TRUE:
+ * time then only moves forward when sleep_until_usecs() is called, which
+ * returns at once. Animations produce exactly the frames they would at their
+ * normal pace but without waiting, e.g., to benchmark them.
  *
  */
-boolean_t fn_less(int var, int bound)
+void set_virtual_clock(boolean_t enable)
 {
-	if (var <= bound)
-		return TRUE;
-	return FALSE;
+	virtual_usecs = enable ? 0 : -1;
 }
 
 /*
  *
- * Return TRUE if @var is greater than or equal to @bound, FALSE otherwise.
- * fn_less() and fn_greater() are functions called as continuity condition of
- * loops which can iterate both positively and negatively. See main.c:animate_card()
- * for a use case.
+ * Return the time elapsed since an arbitrary point of the past, in microseconds.
+ * The clock is monotonic, so that it is suitable to measure intervals.
  *
  */
-boolean_t fn_greater(int var, int bound)
+long long get_time_usecs(void)
 {
-	if (var >= bound)
-		return TRUE;
-	return FALSE;
+	struct timespec ts;
+
+
+	if (virtual_usecs != -1)
+		return virtual_usecs;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
 /*
  *
- * Create @timerid timer with event notifications based on threads running
- * the notify function @notify_fn, which receives @fn_arg as its only argument.
- * Then, you can write the notify function to process conditionally the
- * argument and execute different branches for each of them. See main.c:do_timer()
- * for an example.
+ * Sleep until get_time_usecs() reaches @usecs, running the notify functions of
+ * the timers which expire meanwhile. Return at once if it is already in the past.
  *
  */
-void do_timer_prepare(timer_t *timerid, void (*notify_fn)(union sigval), int fn_arg)
+void sleep_until_usecs(long long usecs)
 {
-	struct sigevent sev = { { 0 } };
+	struct pollfd pfd;
+	long long now;
 
 
-	sev.sigev_notify = SIGEV_THREAD;
-	sev.sigev_notify_function = notify_fn;
-	sev.sigev_value.sival_int = fn_arg;
-	timer_create(CLOCK_REALTIME, &sev, timerid);
+	if (virtual_usecs != -1) {
+		if (usecs > virtual_usecs)
+			virtual_usecs = usecs;
+		return;
+	}
+
+	pfd.fd = wheel_fd;
+	pfd.events = POLLIN;
+	while ((now = get_time_usecs()) < usecs) {
+		if (poll(&pfd, wheel_fd != -1 ? 1 : 0, (usecs - now + 999) / 1000) > 0)
+			do_timer_dispatch();
+	}
 }
 
 /*
  *
- * Set @timerid interval to be triggered to @secs seconds and @nsecs
- * nanoseconds. @timerid must be first created with do_timer_prepare().
+ * Insert @timer in the slot of the wheel where it expires, @ticks ticks from now.
  *
  */
-void do_timer_set(timer_t *timerid, time_t secs, signed long nsecs)
+static void wheel_insert(wheel_timer_t *timer, unsigned ticks)
 {
-	struct itimerspec its = { { 0 }, { 0 } };
+	unsigned slot;
+
+
+	timer->expires = wheel_ticks + ticks;
+	slot = timer->expires % WHEEL_SLOTS;
+	timer->next = wheel[slot];
+	wheel[slot] = timer;
+}
+
+/*
+ *
+ * Remove @timer from the slot of the wheel where it is waiting.
+ *
+ */
+static void wheel_remove(wheel_timer_t *timer)
+{
+	wheel_timer_t **pp;
 
 
-	its.it_interval.tv_sec = its.it_value.tv_sec = secs;
-	its.it_interval.tv_nsec = its.it_value.tv_nsec = nsecs;
-	timer_settime(timerid, TIMER_ABSTIME, &its, NULL);
+	for (pp=&wheel[timer->expires % WHEEL_SLOTS];*pp;pp=&(*pp)->next) {
+		if (*pp == timer) {
+			*pp = timer->next;
+			break;
+		}
+	}
+	timer->next = NULL;
 }
 
 /*
  *
- * Unset the specified timer @timerid: that is, set interval of execution to 0.
+ * Make the timerfd behind the wheel tick every WHEEL_TICK nanoseconds if
+ * @on is TRUE, or stop it otherwise, so that an idle game does not wake up.
  *
  */
-void do_timer_unset(timer_t *timerid)
+static void wheel_run(boolean_t on)
 {
 	struct itimerspec its = { { 0 }, { 0 } };
 
 
-	its.it_value.tv_sec = 0;
-	its.it_value.tv_nsec = 0;
-	timer_settime(timerid, TIMER_ABSTIME, &its, NULL);
+	if (on)
+		its.it_interval.tv_nsec = its.it_value.tv_nsec = WHEEL_TICK;
+	timerfd_settime(wheel_fd, 0, &its, NULL);
+}
+
+/*
+ *
+ * Initialize @timer so that the notify function @notify_fn is called with
+ * @fn_arg as its only argument each time it expires. Then, you can write the
+ * notify function to process conditionally the argument and execute different
+ * branches for each of them. See main.c:do_timer() for an example.
+ *
+ * All of the timers are kept in a single timer wheel driven by a timerfd, whose
+ * descriptor is returned by do_timer_fd(). Notify functions are run from
+ * do_timer_dispatch() in the thread of the caller (i.e., the main loop), so
+ * they need no locking at all.
+ *
+ */
+void do_timer_prepare(wheel_timer_t *timer, void (*notify_fn)(int), int fn_arg)
+{
+	timer->notify_fn = notify_fn;
+	timer->fn_arg = fn_arg;
+	timer->interval = 0;
+	timer->next = NULL;
+	if (wheel_fd == -1) {
+		wheel_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+		if (wheel_fd == -1)
+			perror("timerfd_create");
+	}
+}
+
+/*
+ *
+ * Arm @timer to expire on the next tick of the wheel and then every @secs
+ * seconds plus @nsecs nanoseconds, rounded to ticks of WHEEL_TICK.
+ *
+ */
+void do_timer_set(wheel_timer_t *timer, time_t secs, signed long nsecs)
+{
+	unsigned long long interval;
+
+
+	do_timer_unset(timer);
+	interval = ((unsigned long long)secs * 1000000000 + nsecs + WHEEL_TICK / 2) / WHEEL_TICK;
+	timer->interval = interval ? interval : 1;
+	if (!wheel_armed++)
+		wheel_run(TRUE);
+	wheel_insert(timer, 1);
+}
+
+/*
+ *
+ * Disarm @timer. It is safe to call it on timers which are not armed.
+ *
+ */
+void do_timer_unset(wheel_timer_t *timer)
+{
+	if (!timer->interval)
+		return;
+
+	wheel_remove(timer);
+	timer->interval = 0;
+	if (!--wheel_armed)
+		wheel_run(FALSE);
+}
+
+/*
+ *
+ * Return the descriptor to poll for expirations of the timers.
+ *
+ */
+int do_timer_fd(void)
+{
+	return wheel_fd;
+}
+
+/*
+ *
+ * Advance the wheel by as many ticks as have elapsed and run the notify
+ * functions of the timers that expired. Only the slots of those ticks are
+ * visited, and a timer that expired several times (e.g., while the game was
+ * busy) is notified once. Each expired timer is rescheduled before its notify
+ * function runs, so that the latter may disarm it.
+ *
+ */
+void do_timer_dispatch(void)
+{
+	unsigned long long i, n, old, expirations = 0;
+	wheel_timer_t *timer;
+
+
+	if (read(wheel_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		return;
+
+	old = wheel_ticks;
+	wheel_ticks += expirations;
+	n = expirations < WHEEL_SLOTS ? expirations : WHEEL_SLOTS;
+	for (i=1;i<=n;i++) {
+again:
+		for (timer=wheel[(old + i) % WHEEL_SLOTS];timer;timer=timer->next) {
+			if (timer->expires > wheel_ticks)
+				continue;
+
+			wheel_remove(timer);
+			wheel_insert(timer, timer->interval);
+			timer->notify_fn(timer->fn_arg);
+
+			// the slot may have changed under our feet
+			goto again;
+		}
+	}
 }
 
 /*
@@ -408,6 +554,8 @@ int parse_conf_file(char *filename)
 
 			} else if (strlen(line) >= 11 && !strncmp(line, "SkipFrames=", 11)) {
 				skipframes = strtol(dict_get_value(line), NULL, 10);
+				if (skipframes < 1)
+					skipframes = 1;
 
 			} else if (strlen(line) >= 6 && !strncmp(line, "Total=", 6)) {
 				game_total = strtol(dict_get_value(line), NULL, 10);
@@ -22,7 +22,6 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <time.h>
-#include <signal.h>
 #include "gui.h"
 
 #ifndef _SRC_MISC_H_
@@ -32,12 +31,23 @@
 typedef enum { FALSE=0, TRUE } boolean_t;
 #endif
 
+typedef struct wheel_timer_st {
+	void (*notify_fn)(int);
+	int fn_arg;
+	unsigned long long interval;	// Period in ticks, 0 if the timer is not armed
+	unsigned long long expires;	// Tick when the timer expires next
+	struct wheel_timer_st *next;	// Next timer in the same slot of the wheel
+} wheel_timer_t;
+
 void print_rules(gui_dialog_t *dlg, char *filename);
-boolean_t fn_less(int var, int bound);
-boolean_t fn_greater(int var, int bound);
-void do_timer_prepare(timer_t *timerid, void (*notify_fn)(union sigval), int fn_arg);
-void do_timer_set(timer_t *timerid, time_t secs, signed long nsecs);
-void do_timer_unset(timer_t *timerid);
+void set_virtual_clock(boolean_t enable);
+long long get_time_usecs(void);
+void sleep_until_usecs(long long usecs);
+void do_timer_prepare(wheel_timer_t *timer, void (*notify_fn)(int), int fn_arg);
+void do_timer_set(wheel_timer_t *timer, time_t secs, signed long nsecs);
+void do_timer_unset(wheel_timer_t *timer);
+int do_timer_fd(void);
+void do_timer_dispatch(void);
 void decode_card_rev(char *card, int *ret_suit, int *ret_number);
 int get_nth_field(char *str, int n);
 char *expand_tilde(char **environment);
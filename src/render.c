@@ -0,0 +1,990 @@
+/*
+ * render.c: back buffer of the table with tracking of damaged areas
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "render.h"
+
+#define MAX_INTERSECTIONS	16
+#define STALE_PIXEL		0xff000000	// Never written to the back buffer
+
+// One pixel, with a channel in each lane, so that resampling works on all of
+// them at once with the vector instructions of the machine
+typedef float render_v4sf_t __attribute__((vector_size(4 * sizeof(float))));
+
+/*
+ *
+ * Allocate a frame of @width x @height pixels for the backend @backend, with
+ * its back buffer and its shadow. @shadow may point to memory provided by the
+ * backend (e.g., the image it sends), which must be @width pixels wide and
+ * which the backend remains responsible for; if NULL, it is allocated here.
+ * Backends call this from their own constructors. Return NULL on
+ * allocation errors.
+ *
+ */
+render_frame_t *render_initframe(const render_backend_t *backend, unsigned width, unsigned height,
+				 unsigned int *shadow)
+{
+	render_frame_t *fr = NULL;
+
+
+	fr = (render_frame_t *)calloc(1, sizeof(render_frame_t));
+	if (!fr)
+		return NULL;
+
+	fr->backend = backend;
+	fr->width = width;
+	fr->height = height;
+	fr->vwidth = width;
+	fr->vheight = height;
+	fr->scale = RENDER_SCALE_ONE;
+	fr->stride = width;
+	fr->pixels = (unsigned int *)calloc(width * height, sizeof(unsigned int));
+	fr->shadow = shadow ? shadow : (unsigned int *)calloc(width * height, sizeof(unsigned int));
+	if (!fr->pixels || !fr->shadow) {
+		free(fr->pixels);
+		if (!shadow)
+			free(fr->shadow);
+		free(fr);
+		return NULL;
+	}
+
+	// nothing has been sent yet
+	memset(fr->shadow, 0xff, width * height * sizeof(unsigned int));
+
+	return fr;
+}
+
+/*
+ *
+ * Let the backend of @fr release its resources and free the frame.
+ *
+ */
+void render_destroyframe(render_frame_t *fr)
+{
+	if (!fr)
+		return;
+
+	if (fr->backend && fr->backend->destroy)
+		fr->backend->destroy(fr);
+	free(fr->pixels);
+	free(fr->shadow);
+	free(fr->glyphs);
+	free(fr);
+}
+
+/*
+ *
+ * Reallocate the back buffer and the shadow of @fr for @width x @height pixels,
+ * the latter through the backend if it provides it. Nothing is displayed yet.
+ * Return 0 on success or -1 on allocation errors, after which the frame can
+ * only be destroyed.
+ *
+ */
+static int render_realloc(render_frame_t *fr, unsigned width, unsigned height)
+{
+	unsigned int *shadow = NULL;
+
+
+	free(fr->pixels);
+	fr->pixels = NULL;
+	if (fr->backend->resize && fr->backend->resize(fr, width, height, &shadow))
+		return -1;
+
+	free(fr->shadow);
+	fr->shadow = shadow ? shadow : (unsigned int *)calloc(width * height, sizeof(unsigned int));
+	fr->pixels = (unsigned int *)calloc(width * height, sizeof(unsigned int));
+	if (!fr->pixels || !fr->shadow)
+		return -1;
+
+	fr->width = width;
+	fr->height = height;
+	fr->stride = width;
+	fr->ndamage = 0;
+	memset(fr->shadow, 0xff, width * height * sizeof(unsigned int));
+
+	return 0;
+}
+
+/*
+ *
+ * Map the coordinates of the area callers draw on to the pixels of @fr.
+ *
+ */
+static int render_x(render_frame_t *fr, int x)
+{
+	return fr->origin_x + (int)(((long)x * fr->scale) >> RENDER_SCALE_SHIFT);
+}
+
+static int render_y(render_frame_t *fr, int y)
+{
+	return fr->origin_y + (int)(((long)y * fr->scale) >> RENDER_SCALE_SHIFT);
+}
+
+/*
+ *
+ * Return how many pixels of @fr the length @len of the area callers draw on
+ * takes, e.g., to size the buffer given to render_read().
+ *
+ */
+unsigned render_scaled(render_frame_t *fr, unsigned len)
+{
+	return (len * fr->scale) >> RENDER_SCALE_SHIFT;
+}
+
+/*
+ *
+ * Convert the pixel (@x, @y) of @fr, e.g., where the mouse was clicked, to the
+ * coordinates of the area callers draw on.
+ *
+ */
+void render_unscale(render_frame_t *fr, int *x, int *y)
+{
+	*x = ((long)(*x - fr->origin_x) << RENDER_SCALE_SHIFT) / (long)fr->scale;
+	*y = ((long)(*y - fr->origin_y) << RENDER_SCALE_SHIFT) / (long)fr->scale;
+}
+
+/*
+ *
+ * Clip the rectangle (@x, @y, @w, @h) to the bounds of the frame @fr.
+ * Return FALSE if nothing is left to draw.
+ *
+ */
+static boolean_t render_clip(render_frame_t *fr, int *x, int *y, int *w, int *h)
+{
+	if (*x < 0) {
+		*w += *x;
+		*x = 0;
+	}
+	if (*y < 0) {
+		*h += *y;
+		*y = 0;
+	}
+	if (*x + *w > (int)fr->width)
+		*w = fr->width - *x;
+	if (*y + *h > (int)fr->height)
+		*h = fr->height - *y;
+
+	return *w > 0 && *h > 0 ? TRUE : FALSE;
+}
+
+static long render_area(render_rect_t *r)
+{
+	return (long)(r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static void render_union(render_rect_t *dst, render_rect_t *src)
+{
+	if (src->x0 < dst->x0)
+		dst->x0 = src->x0;
+	if (src->y0 < dst->y0)
+		dst->y0 = src->y0;
+	if (src->x1 > dst->x1)
+		dst->x1 = src->x1;
+	if (src->y1 > dst->y1)
+		dst->y1 = src->y1;
+}
+
+/*
+ *
+ * Add @r to the damaged areas of @fr. Rectangles that overlap or touch are
+ * merged; when the list is full, @r is merged with the rectangle whose
+ * bounding box grows the least.
+ *
+ */
+static void render_adddamage(render_frame_t *fr, render_rect_t *r)
+{
+	render_rect_t *d, u;
+	unsigned i, best;
+	long cost, mincost;
+
+
+again:
+	for (i=0;i<fr->ndamage;i++) {
+		d = &fr->damage[i];
+		if (r->x0 <= d->x1 && d->x0 <= r->x1 && r->y0 <= d->y1 && d->y0 <= r->y1) {
+			render_union(r, d);
+			*d = fr->damage[--fr->ndamage];
+			goto again;
+		}
+	}
+
+	if (fr->ndamage == RENDER_MAX_DAMAGE) {
+		mincost = LONG_MAX;
+		for (best=0,i=0;i<fr->ndamage;i++) {
+			u = fr->damage[i];
+			render_union(&u, r);
+			cost = render_area(&u) - render_area(&fr->damage[i]) - render_area(r);
+			if (cost < mincost) {
+				mincost = cost;
+				best = i;
+			}
+		}
+		render_union(r, &fr->damage[best]);
+		fr->damage[best] = fr->damage[--fr->ndamage];
+		goto again;
+	}
+
+	fr->damage[fr->ndamage++] = *r;
+}
+
+static void render_damagepx(render_frame_t *fr, int x, int y, int w, int h)
+{
+	render_rect_t r;
+	int cw = w, ch = h;
+
+
+	if (!render_clip(fr, &x, &y, &cw, &ch))
+		return;
+
+	r.x0 = x;
+	r.y0 = y;
+	r.x1 = x + cw;
+	r.y1 = y + ch;
+	render_adddamage(fr, &r);
+}
+
+/*
+ *
+ * Record that the rectangle (@x, @y, @w, @h) of the back buffer of @fr has
+ * changed and must be sent on the next call to render_flush().
+ *
+ */
+void render_damage(render_frame_t *fr, int x, int y, unsigned w, unsigned h)
+{
+	int x0 = render_x(fr, x), y0 = render_y(fr, y);
+
+
+	render_damagepx(fr, x0, y0, render_x(fr, x + w) - x0, render_y(fr, y + h) - y0);
+}
+
+/*
+ *
+ * Resize @fr to @width x @height pixels, e.g., when its window is resized.
+ * The area callers draw on keeps its size: it is scaled to fit in the frame,
+ * without changing its aspect ratio, and centered. The layers shown on top
+ * of it, if any, are scaled as well. Both are left blank, so that everything must be drawn
+ * again. Return 0 on success or -1 on allocation errors, after which the
+ * frame can only be destroyed.
+ *
+ */
+int render_resize(render_frame_t *fr, unsigned width, unsigned height)
+{
+	render_frame_t *l;
+	unsigned i, sx, sy;
+
+
+	if (render_realloc(fr, width, height))
+		return -1;
+
+	sx = (width << RENDER_SCALE_SHIFT) / fr->vwidth;
+	sy = (height << RENDER_SCALE_SHIFT) / fr->vheight;
+	fr->scale = sx < sy ? sx : sy;
+	if (!fr->scale)
+		fr->scale = 1;
+	fr->origin_x = (width - render_scaled(fr, fr->vwidth)) / 2;
+	fr->origin_y = (height - render_scaled(fr, fr->vheight)) / 2;
+	render_damagepx(fr, 0, 0, width, height);
+
+	for (i=0;i<RENDER_MAX_LAYERS;i++) {
+		l = fr->overlay[i];
+		if (!l)
+			continue;
+		if (render_realloc(l, render_scaled(fr, l->vwidth), render_scaled(fr, l->vheight)))
+			return -1;
+		l->scale = fr->scale;
+	}
+
+	return 0;
+}
+
+/*
+ *
+ * Forget what the window displays in the rectangle (@x, @y, @w, @h), e.g.,
+ * because it has been exposed, so that it is sent again on the next call to
+ * render_flush() even if the back buffer has not changed there. Unlike for
+ * drawing routines, the rectangle is given in pixels of the frame.
+ *
+ */
+void render_invalidate(render_frame_t *fr, int x, int y, unsigned w, unsigned h)
+{
+	int i, j, cw = w, ch = h;
+	unsigned int *row;
+
+
+	if (!render_clip(fr, &x, &y, &cw, &ch))
+		return;
+
+	for (i=0;i<ch;i++) {
+		row = fr->shadow + (y + i) * fr->width + x;
+		for (j=0;j<cw;j++)
+			row[j] = STALE_PIXEL;
+	}
+	render_damagepx(fr, x, y, cw, ch);
+}
+
+/*
+ *
+ * Show the frame @layer on top of the back buffer of @fr at @depth, with its
+ * top left corner at (@x, @y), e.g., for a dialog. The back buffer can still
+ * be drawn below it, but only the layer is displayed there, or the one at a
+ * greater depth where they overlap. One layer is shown at each depth, up to
+ * RENDER_MAX_LAYERS; a NULL @layer removes it, and what was held back below
+ * is sent on the next flush.
+ *
+ */
+void render_showlayer(render_frame_t *fr, unsigned depth, render_frame_t *layer, int x, int y)
+{
+	render_frame_t *l = fr->overlay[depth];
+
+
+	if (l)
+		render_invalidate(fr, render_x(fr, fr->overlay_x[depth]), render_y(fr, fr->overlay_y[depth]),
+				  l->width, l->height);
+
+	fr->overlay[depth] = layer;
+	fr->overlay_x[depth] = x;
+	fr->overlay_y[depth] = y;
+	if (layer) {
+		layer->ndamage = 0;
+		render_invalidate(fr, render_x(fr, x), render_y(fr, y), layer->width, layer->height);
+	}
+}
+
+/*
+ *
+ * Show the frame @layer on top of the back buffer of @fr, below any other
+ * layer, as described in render_showlayer().
+ *
+ */
+void render_overlay(render_frame_t *fr, render_frame_t *layer, int x, int y)
+{
+	render_showlayer(fr, 0, layer, x, y);
+}
+
+/*
+ *
+ * Fill the rectangle at (@x, @y) of @w x @h pixels of the frame @fr with @color.
+ *
+ */
+void render_fill(render_frame_t *fr, unsigned long color, int x, int y, unsigned w, unsigned h)
+{
+	int i, j, cx, cy, cw, ch;
+	unsigned int *row;
+
+
+	cx = render_x(fr, x);
+	cy = render_y(fr, y);
+	cw = render_x(fr, x + w) - cx;
+	ch = render_y(fr, y + h) - cy;
+	if (!render_clip(fr, &cx, &cy, &cw, &ch))
+		return;
+
+	for (i=0;i<ch;i++) {
+		row = fr->pixels + (cy + i) * fr->stride + cx;
+		for (j=0;j<cw;j++)
+			row[j] = color;
+	}
+	render_damagepx(fr, cx, cy, cw, ch);
+}
+
+/*
+ *
+ * Copy the block of @w x @h pixels of @pixels onto the frame @fr at (@x, @y).
+ * Unlike the position, the size of the block is given in pixels of the frame,
+ * e.g., as read by render_read().
+ *
+ */
+void render_blit(render_frame_t *fr, const unsigned int *pixels, unsigned w, unsigned h, int x, int y)
+{
+	int i, cx, cy, cw = w, ch = h;
+
+
+	x = cx = render_x(fr, x);
+	y = cy = render_y(fr, y);
+	if (!render_clip(fr, &cx, &cy, &cw, &ch))
+		return;
+
+	pixels += (cy - y) * w + (cx - x);
+	for (i=0;i<ch;i++)
+		memcpy(fr->pixels + (cy + i) * fr->stride + cx, pixels + i * w, cw * sizeof(unsigned int));
+	render_damagepx(fr, cx, cy, cw, ch);
+}
+
+static int render_floor(float f)
+{
+	int i = (int)f;
+
+
+	return (float)i > f ? i - 1 : i;
+}
+
+/*
+ *
+ * Compute the taps of a triangle filter which resamples @n pixels into @dn:
+ * output pixel i is the sum of the source pixels at @index[i * @ntaps] onwards
+ * weighted by @weight[i * @ntaps] onwards. When enlarging, this amounts to
+ * linear interpolation; when shrinking, the filter is widened so that every
+ * source pixel is accounted for. Return NULL on allocation errors, or the
+ * weights, which share the allocated memory with the indices.
+ *
+ */
+static float *render_taps(unsigned n, unsigned dn, int **index, unsigned *ntaps)
+{
+	float ratio = (float)n / dn, radius = ratio > 1 ? ratio : 1;
+	float c, d, sum, *weight = NULL;
+	unsigned i, k;
+	int first, j;
+
+
+	*ntaps = (unsigned)(2 * radius) + 1;
+	weight = (float *)calloc(dn * *ntaps, sizeof(float) + sizeof(int));
+	if (!weight)
+		return NULL;
+	*index = (int *)(weight + dn * *ntaps);
+
+	for (i=0;i<dn;i++) {
+		c = (i + 0.5) * ratio - 0.5;
+		first = render_floor(c - radius) + 1;
+		for (sum=0,k=0;k<*ntaps;k++) {
+			d = first + (int)k - c;
+			d = 1 - (d < 0 ? -d : d) / radius;
+			if (d > 0) {
+				weight[i * *ntaps + k] = d;
+				sum += d;
+			}
+			j = first + (int)k;
+			(*index)[i * *ntaps + k] = j < 0 ? 0 : j < (int)n ? j : (int)n - 1;
+		}
+		for (k=0;k<*ntaps;k++)
+			weight[i * *ntaps + k] /= sum;
+	}
+
+	return weight;
+}
+
+/*
+ *
+ * Resample the @w x @h block of palette indices @indices, as described in
+ * render_blitindexed(), into the pixels of @sprite for the scale @scale. Rows
+ * are filtered first, then columns, each pixel being computed as a whole.
+ * Return 0 on success or -1 on allocation errors.
+ *
+ */
+static int render_resample(render_sprite_t *sprite, const void *indices, unsigned isize, const unsigned int *palette,
+			   unsigned stride, unsigned w, unsigned h, unsigned scale)
+{
+	render_v4sf_t *line = NULL, *tmp = NULL, acc, zero = { 0, 0, 0, 0 };
+	unsigned int *pixels = NULL, p;
+	unsigned dw, dh, x, y, k, ntx, nty, c[3];
+	int *ix = NULL, *iy = NULL;
+	float *wx = NULL, *wy = NULL;
+
+
+	dw = (w * scale) >> RENDER_SCALE_SHIFT;
+	dh = (h * scale) >> RENDER_SCALE_SHIFT;
+	if (!dw || !dh)
+		return -1;
+
+	pixels = (unsigned int *)realloc(sprite->pixels, dw * dh * sizeof(unsigned int));
+	if (!pixels)
+		return -1;
+	sprite->pixels = pixels;
+
+	line = (render_v4sf_t *)calloc(w, sizeof(render_v4sf_t));
+	tmp = (render_v4sf_t *)calloc(dw * h, sizeof(render_v4sf_t));
+	wx = render_taps(w, dw, &ix, &ntx);
+	wy = render_taps(h, dh, &iy, &nty);
+	if (!line || !tmp || !wx || !wy) {
+		free(line);
+		free(tmp);
+		free(wx);
+		free(wy);
+		return -1;
+	}
+
+	for (y=0;y<h;y++) {
+		for (x=0;x<w;x++) {
+			if (isize == 1)
+				p = palette[((const unsigned char *)indices)[y * stride + x]];
+			else
+				p = palette[((const unsigned short *)indices)[y * stride + x]];
+			line[x] = (render_v4sf_t){ (p >> 16) & 0xff, (p >> 8) & 0xff, p & 0xff, 0 };
+		}
+		for (x=0;x<dw;x++) {
+			acc = zero;
+			for (k=0;k<ntx;k++)
+				acc += wx[x * ntx + k] * line[ix[x * ntx + k]];
+			tmp[y * dw + x] = acc;
+		}
+	}
+
+	for (y=0;y<dh;y++) {
+		for (x=0;x<dw;x++) {
+			acc = zero;
+			for (k=0;k<nty;k++)
+				acc += wy[y * nty + k] * tmp[iy[y * nty + k] * dw + x];
+			for (k=0;k<3;k++)
+				c[k] = acc[k] < 0 ? 0 : acc[k] > 255 ? 255 : (unsigned)(acc[k] + 0.5);
+			pixels[y * dw + x] = c[0] << 16 | c[1] << 8 | c[2];
+		}
+	}
+
+	free(line);
+	free(tmp);
+	free(wx);
+	free(wy);
+	sprite->scale = scale;
+	sprite->width = dw;
+	sprite->height = dh;
+
+	return 0;
+}
+
+/*
+ *
+ * Make @sprite hold the @w x @h block of palette indices @indices, as
+ * described in render_blitindexed(), at the scale of @fr, unless it already
+ * does. At the natural size, the indices are just looked up in @palette.
+ * Return 0 on success or -1 on allocation errors.
+ *
+ */
+int render_loadsprite(render_frame_t *fr, const void *indices, unsigned isize, const unsigned int *palette,
+		      unsigned stride, unsigned w, unsigned h, render_sprite_t *sprite)
+{
+	unsigned int *pixels = NULL;
+	unsigned i, j;
+
+
+	if (sprite->scale == fr->scale)
+		return 0;
+	if (fr->scale != RENDER_SCALE_ONE)
+		return render_resample(sprite, indices, isize, palette, stride, w, h, fr->scale);
+
+	pixels = (unsigned int *)realloc(sprite->pixels, w * h * sizeof(unsigned int));
+	if (!pixels)
+		return -1;
+
+	for (i=0;i<h;i++) {
+		for (j=0;j<w;j++) {
+			if (isize == 1)
+				pixels[i * w + j] = palette[((const unsigned char *)indices)[i * stride + j]];
+			else
+				pixels[i * w + j] = palette[((const unsigned short *)indices)[i * stride + j]];
+		}
+	}
+	sprite->pixels = pixels;
+	sprite->scale = fr->scale;
+	sprite->width = w;
+	sprite->height = h;
+
+	return 0;
+}
+
+/*
+ *
+ * Free the pixels of @sprite, so that they are resampled again on next use.
+ *
+ */
+void render_freesprite(render_sprite_t *sprite)
+{
+	free(sprite->pixels);
+	sprite->pixels = NULL;
+	sprite->scale = 0;
+}
+
+/*
+ *
+ * Copy the @w x @h block of palette indices @indices, whose rows are @stride
+ * indices apart, onto the frame @fr at (@x, @y). Indices take @isize bytes
+ * each (1 or 2) and are looked up in @palette while being copied. If @fr is
+ * scaled, the block is resampled instead into @sprite the first time it is
+ * drawn at that scale, and the latter is copied from then on; if @sprite is
+ * NULL, the block is resampled on each call.
+ *
+ */
+void render_blitindexed(render_frame_t *fr, const void *indices, unsigned isize, const unsigned int *palette,
+			unsigned stride, unsigned w, unsigned h, int x, int y, render_sprite_t *sprite)
+{
+	int i, j, cx, cy, cw = w, ch = h;
+	const unsigned char *idx8;
+	const unsigned short *idx16;
+	unsigned int *row;
+	render_sprite_t tmp = { 0 };
+
+
+	if (fr->scale != RENDER_SCALE_ONE) {
+		if (!sprite)
+			sprite = &tmp;
+		if (!render_loadsprite(fr, indices, isize, palette, stride, w, h, sprite))
+			render_blit(fr, sprite->pixels, sprite->width, sprite->height, x, y);
+		free(tmp.pixels);
+		return;
+	}
+
+	x = cx = render_x(fr, x);
+	y = cy = render_y(fr, y);
+	if (!render_clip(fr, &cx, &cy, &cw, &ch))
+		return;
+
+	for (i=0;i<ch;i++) {
+		row = fr->pixels + (cy + i) * fr->stride + cx;
+		if (isize == 1) {
+			idx8 = (const unsigned char *)indices + (cy - y + i) * stride + (cx - x);
+			for (j=0;j<cw;j++)
+				row[j] = palette[idx8[j]];
+		} else {
+			idx16 = (const unsigned short *)indices + (cy - y + i) * stride + (cx - x);
+			for (j=0;j<cw;j++)
+				row[j] = palette[idx16[j]];
+		}
+	}
+	render_damagepx(fr, cx, cy, cw, ch);
+}
+
+/*
+ *
+ * Show @sprite, loaded for the scale of @fr (see render_loadsprite()), at
+ * (@x, @y) on top of what the destination of @fr displays, without drawing it
+ * on the back buffer, e.g., for a card being moved across the table. The
+ * backend puts back what the sprite covered when it is moved again, or
+ * removed with a NULL @sprite; anything presented over it hides it. Return
+ * -1 if the backend cannot do so, or if the sprite would cover any of the
+ * layers shown on top of @fr, in which case it is removed and callers draw
+ * it themselves.
+ *
+ */
+int render_movesprite(render_frame_t *fr, render_sprite_t *sprite, int x, int y)
+{
+	render_frame_t *l;
+	unsigned i;
+	int lx, ly;
+
+
+	if (!fr->backend->sprite || (sprite && sprite->scale != fr->scale))
+		return -1;
+
+	x = render_x(fr, x);
+	y = render_y(fr, y);
+	for (i=0;sprite && i<RENDER_MAX_LAYERS;i++) {
+		l = fr->overlay[i];
+		if (!l)
+			continue;
+		lx = render_x(fr, fr->overlay_x[i]);
+		ly = render_y(fr, fr->overlay_y[i]);
+		if (x < lx + (int)l->width && lx < x + (int)sprite->width &&
+		    y < ly + (int)l->height && ly < y + (int)sprite->height) {
+			fr->backend->sprite(fr, NULL, 0, 0);
+			return -1;
+		}
+	}
+
+	return fr->backend->sprite(fr, sprite, x, y);
+}
+
+/*
+ *
+ * Copy the block of @w x @h pixels at (@x, @y) of the frame @fr into @pixels,
+ * whose rows are @w pixels apart. As for render_blit(), the size is given in
+ * pixels of the frame (see render_scaled()). Parts of the block outside of
+ * the frame are left untouched, so that render_blit() puts back exactly what
+ * has been read.
+ *
+ */
+void render_read(render_frame_t *fr, unsigned int *pixels, int x, int y, unsigned w, unsigned h)
+{
+	int i, cx, cy, cw = w, ch = h;
+
+
+	x = cx = render_x(fr, x);
+	y = cy = render_y(fr, y);
+	if (!render_clip(fr, &cx, &cy, &cw, &ch))
+		return;
+
+	pixels += (cy - y) * w + (cx - x);
+	for (i=0;i<ch;i++)
+		memcpy(pixels + i * w, fr->pixels + (cy + i) * fr->stride + cx, cw * sizeof(unsigned int));
+}
+
+static int render_ceil(float f)
+{
+	int i = (int)f;
+
+
+	return (float)i < f ? i + 1 : i;
+}
+
+/*
+ *
+ * Fill the polygon described by @npoints @points on the frame @fr with @color.
+ * Pixels are painted when their centers lie inside the polygon (even-odd
+ * rule), which matches what XFillPolygon() does for the small shapes drawn
+ * by the game. Only the first MAX_INTERSECTIONS points are taken.
+ *
+ */
+void render_polygon(render_frame_t *fr, unsigned long color, XPoint *points, int npoints)
+{
+	int i, j, k, n, py, px, x0, x1, miny, maxy, minx, maxx;
+	float yc, cross[MAX_INTERSECTIONS], t;
+	unsigned int *row;
+	XPoint scaled[MAX_INTERSECTIONS];
+
+
+	if (npoints < 3)
+		return;
+
+	if (npoints > MAX_INTERSECTIONS)
+		npoints = MAX_INTERSECTIONS;
+	for (i=0;i<npoints;i++) {
+		scaled[i].x = render_x(fr, points[i].x);
+		scaled[i].y = render_y(fr, points[i].y);
+	}
+	points = scaled;
+
+	miny = maxy = points[0].y;
+	minx = maxx = points[0].x;
+	for (i=1;i<npoints;i++) {
+		if (points[i].y < miny)
+			miny = points[i].y;
+		if (points[i].y > maxy)
+			maxy = points[i].y;
+		if (points[i].x < minx)
+			minx = points[i].x;
+		if (points[i].x > maxx)
+			maxx = points[i].x;
+	}
+	if (miny < 0)
+		miny = 0;
+	if (maxy > (int)fr->height)
+		maxy = fr->height;
+
+	for (py=miny;py<maxy;py++) {
+		yc = py + 0.5;
+		for (n=0,i=0,j=npoints-1;i<npoints && n<MAX_INTERSECTIONS;j=i,i++) {
+			if ((points[i].y <= yc && points[j].y > yc) ||
+			    (points[j].y <= yc && points[i].y > yc)) {
+				cross[n++] = points[i].x + (yc - points[i].y) *
+					     (points[j].x - points[i].x) / (points[j].y - points[i].y);
+			}
+		}
+
+		// sort intersections (there are only a few of them)
+		for (i=1;i<n;i++) {
+			t = cross[i];
+			for (k=i-1;k>=0 && cross[k]>t;k--)
+				cross[k + 1] = cross[k];
+			cross[k + 1] = t;
+		}
+
+		row = fr->pixels + py * fr->stride;
+		for (i=0;i+1<n;i+=2) {
+			x0 = render_ceil(cross[i] - 0.5);
+			x1 = render_ceil(cross[i + 1] - 0.5);
+			if (x0 < 0)
+				x0 = 0;
+			if (x1 > (int)fr->width)
+				x1 = fr->width;
+			for (px=x0;px<x1;px++)
+				row[px] = color;
+		}
+	}
+	if (maxy > miny)
+		render_damagepx(fr, minx, miny, maxx - minx + 1, maxy - miny);
+}
+
+/*
+ *
+ * Draw the first @len characters of @str with @fg over a box filled with @bg,
+ * the same way XDrawImageString() does: (@x, @y) is the origin of the first
+ * character on the baseline.
+ *
+ */
+void render_text(render_frame_t *fr, unsigned long fg, unsigned long bg,
+		 int x, int y, const char *str, int len)
+{
+	int i, gx, gy, px, py, x0, y0, x1, y1, h = fr->fnt_ascent + fr->fnt_descent;
+	unsigned char c;
+
+
+	render_fill(fr, bg, x, y - fr->fnt_ascent, len * fr->fnt_width, h);
+	if (!fr->glyphs)
+		return;
+
+	// each pixel of the box takes the one of the glyph it falls on, so that
+	// the font is enlarged along with everything else on scaled frames
+	y -= fr->fnt_ascent;
+	x0 = render_x(fr, x);
+	y0 = render_y(fr, y);
+	x1 = render_x(fr, x + len * fr->fnt_width);
+	y1 = render_y(fr, y + h);
+	if (x0 < 0)
+		x0 = 0;
+	if (y0 < 0)
+		y0 = 0;
+	if (x1 > (int)fr->width)
+		x1 = fr->width;
+	if (y1 > (int)fr->height)
+		y1 = fr->height;
+
+	for (py=y0;py<y1;py++) {
+		gy = ((long)(py - fr->origin_y) << RENDER_SCALE_SHIFT) / (long)fr->scale - y;
+		if (gy < 0 || gy >= h)
+			continue;
+		for (px=x0;px<x1;px++) {
+			gx = ((long)(px - fr->origin_x) << RENDER_SCALE_SHIFT) / (long)fr->scale - x;
+			i = gx / (int)fr->fnt_width;
+			if (gx < 0 || i >= len)
+				continue;
+			c = str[i];
+			if (c < RENDER_FIRST_GLYPH || c > RENDER_LAST_GLYPH)
+				continue;
+			gx -= i * fr->fnt_width;
+			if (fr->glyphs[((c - RENDER_FIRST_GLYPH) * h + gy) * fr->fnt_width + gx])
+				fr->pixels[py * fr->stride + px] = fg;
+		}
+	}
+}
+
+/*
+ *
+ * Return where the pixels displayed from (@x, @y) onwards are read from, which
+ * is the back buffer of @fr or the topmost of its layers there, and store in
+ * @n how many of them, up to @x1, come from the same place.
+ *
+ */
+static unsigned int *render_source(render_frame_t *fr, int x, int y, int x1, int *n)
+{
+	render_frame_t *l;
+	int i, lx0, lx1, ly0;
+
+
+	for (i=RENDER_MAX_LAYERS-1;i>=0;i--) {
+		l = fr->overlay[i];
+		if (!l)
+			continue;
+		ly0 = render_y(fr, fr->overlay_y[i]);
+		if (y < ly0 || y >= ly0 + (int)l->height)
+			continue;
+
+		lx0 = render_x(fr, fr->overlay_x[i]);
+		lx1 = lx0 + l->width;
+		if (x >= lx0 && x < lx1) {
+			*n = (x1 < lx1 ? x1 : lx1) - x;
+			return l->pixels + (y - ly0) * l->stride + (x - lx0);
+		}
+		if (x < lx0 && lx0 < x1)
+			x1 = lx0;
+	}
+
+	*n = x1 - x;
+	return fr->pixels + y * fr->stride + x;
+}
+
+/*
+ *
+ * Copy into the shadow of @fr the pixels of the rectangle @r that differ from
+ * what is displayed, and let the backend present them. Redrawing something
+ * with the same contents is thus free, no matter how large the area recorded
+ * as damaged is.
+ *
+ */
+static void render_sync(render_frame_t *fr, render_rect_t *r)
+{
+	render_rect_t diff = { INT_MAX, INT_MAX, INT_MIN, INT_MIN };
+	unsigned int *back, *front;
+	int i, x, n, x0, x1;
+
+
+	for (i=r->y0;i<r->y1;i++) {
+		for (x=r->x0;x<r->x1;x+=n) {
+			back = render_source(fr, x, i, r->x1, &n);
+			front = fr->shadow + i * fr->width + x;
+			if (!memcmp(back, front, n * sizeof(unsigned int)))
+				continue;
+
+			for (x0=0;back[x0]==front[x0];x0++);
+			for (x1=n-1;back[x1]==front[x1];x1--);
+			memcpy(front + x0, back + x0, (x1 - x0 + 1) * sizeof(unsigned int));
+			if (x + x0 < diff.x0)
+				diff.x0 = x + x0;
+			if (x + x1 + 1 > diff.x1)
+				diff.x1 = x + x1 + 1;
+			if (diff.y0 == INT_MAX)
+				diff.y0 = i;
+			diff.y1 = i + 1;
+		}
+	}
+	if (diff.y0 == INT_MAX)
+		return;
+
+	fr->backend->present(fr, &diff);
+	fr->presented += (unsigned long long)(diff.x1 - diff.x0) * (diff.y1 - diff.y0);
+}
+
+/*
+ *
+ * Send every damaged area of @fr, and of its layers, to its destination and
+ * start tracking damage again from scratch.
+ *
+ */
+void render_flush(render_frame_t *fr)
+{
+	render_frame_t *l;
+	unsigned long long presented = fr->presented;
+	unsigned i, j;
+	int lx0, ly0;
+
+
+	for (j=0;j<RENDER_MAX_LAYERS;j++) {
+		l = fr->overlay[j];
+		if (!l)
+			continue;
+		lx0 = render_x(fr, fr->overlay_x[j]);
+		ly0 = render_y(fr, fr->overlay_y[j]);
+		for (i=0;i<l->ndamage;i++)
+			render_damagepx(fr, lx0 + l->damage[i].x0, ly0 + l->damage[i].y0,
+					l->damage[i].x1 - l->damage[i].x0, l->damage[i].y1 - l->damage[i].y0);
+		l->ndamage = 0;
+	}
+
+	for (i=0;i<fr->ndamage;i++)
+		render_sync(fr, &fr->damage[i]);
+	fr->ndamage = 0;
+	if (fr->backend->flush)
+		fr->backend->flush(fr);
+	if (fr->presented != presented)
+		fr->frames++;
+}
+
+/*
+ *
+ * Wait until everything flushed through @fr has been sent, for backends
+ * which send frames asynchronously. Requests are accounted in @fr as they
+ * are issued, so they are only all accounted after this returns, e.g.,
+ * before they are reported.
+ *
+ */
+void render_finish(render_frame_t *fr)
+{
+	if (fr->backend->finish)
+		fr->backend->finish(fr);
+}
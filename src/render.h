@@ -0,0 +1,139 @@
+/*
+ *
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _SRC_RENDER_H_
+#define _SRC_RENDER_H_
+#ifndef _HAVE_BOOLEAN_T_
+#define _HAVE_BOOLEAN_T_
+typedef enum { FALSE=0, TRUE } boolean_t;
+#endif
+#include <X11/Xlib.h>
+
+#define RENDER_MAX_DAMAGE	32
+#define RENDER_MAX_LAYERS	2		// Layers shown on top of a frame at once, see render_showlayer()
+#define RENDER_FIRST_GLYPH	' '
+#define RENDER_LAST_GLYPH	'~'
+#define RENDER_NGLYPHS		(RENDER_LAST_GLYPH - RENDER_FIRST_GLYPH + 1)
+#define RENDER_SCALE_SHIFT	8
+#define RENDER_SCALE_ONE	(1 << RENDER_SCALE_SHIFT)	// Scale of a frame drawn at its own size
+
+typedef struct render_rect_st {
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+} render_rect_t;
+
+struct render_frame_st;
+struct render_sprite_st;
+
+/*
+ *
+ * Operations a backend provides to show a frame somewhere: @present sends a
+ * rectangle of the frame's shadow, @flush pushes whatever was presented to
+ * its destination and @destroy frees the private data of the backend.
+ * @resize reallocates what the backend keeps per pixel before the frame is
+ * resized, and stores in @shadow the new shadow if it provides one; it is
+ * optional, as @flush and @destroy. @sprite, also optional, shows a sprite at
+ * (@x, @y) on top of what was presented, without going through the shadow,
+ * and puts back what it covered when moved or when @sprite is NULL. Backends
+ * which send frames asynchronously provide @finish, which waits until
+ * everything flushed has reached its destination.
+ *
+ */
+typedef struct render_backend_st {
+	const char *name;
+	void (*present)(struct render_frame_st *fr, render_rect_t *r);
+	void (*flush)(struct render_frame_st *fr);
+	void (*destroy)(struct render_frame_st *fr);
+	int (*resize)(struct render_frame_st *fr, unsigned width, unsigned height, unsigned int **shadow);
+	int (*sprite)(struct render_frame_st *fr, struct render_sprite_st *sprite, int x, int y);
+	void (*finish)(struct render_frame_st *fr);
+} render_backend_t;
+
+/*
+ *
+ * Image resampled for the scale of a frame, kept by the owner of the indexed
+ * image it comes from so that it is computed once per scale.
+ *
+ */
+typedef struct render_sprite_st {
+	unsigned scale;			// Scale the pixels were resampled for, 0 if none yet
+	unsigned width;
+	unsigned height;
+	unsigned int *pixels;
+} render_sprite_t;
+
+typedef struct render_frame_st {
+	const render_backend_t *backend;
+	void *data;			// Private state of the backend
+	unsigned width;
+	unsigned height;
+	unsigned vwidth;		// Size of the area callers draw on, whatever the size of the frame
+	unsigned vheight;
+	unsigned scale;			// Pixels of the frame per unit of that area, see RENDER_SCALE_ONE
+	int origin_x;			// Where that area is placed on the frame
+	int origin_y;
+	unsigned int *pixels;		// Back buffer (0x00RRGGBB words)
+	unsigned stride;		// Distance in pixels between two rows of the back buffer
+	unsigned int *shadow;		// What the destination displays, overlay included
+	render_rect_t damage[RENDER_MAX_DAMAGE];
+	unsigned ndamage;
+	struct render_frame_st *overlay[RENDER_MAX_LAYERS];	// Layers shown on top of the back buffer, e.g., a dialog
+	int overlay_x[RENDER_MAX_LAYERS];
+	int overlay_y[RENDER_MAX_LAYERS];
+	unsigned char *glyphs;		// Bitmaps of the printable characters of the font
+	unsigned fnt_width;
+	unsigned fnt_ascent;
+	unsigned fnt_descent;
+	unsigned long frames;		// Flushes which sent something
+	unsigned long requests;		// Requests issued by the backend to send them, see render_finish()
+	unsigned long long presented;	// Pixels sent by the backend
+} render_frame_t;
+
+extern render_frame_t *render_initframe(const render_backend_t *backend, unsigned width, unsigned height,
+					unsigned int *shadow);
+extern render_frame_t *render_newframe_x11(Display *dy, Window win, unsigned width, unsigned height);
+extern render_frame_t *render_newframe_mem(unsigned width, unsigned height);
+extern render_frame_t *render_newlayer(render_frame_t *fr, unsigned width, unsigned height);
+extern void render_destroyframe(render_frame_t *fr);
+extern int render_resize(render_frame_t *fr, unsigned width, unsigned height);
+extern unsigned render_scaled(render_frame_t *fr, unsigned len);
+extern void render_unscale(render_frame_t *fr, int *x, int *y);
+extern int render_savepng(render_frame_t *fr, const char *filename);
+extern void render_fill(render_frame_t *fr, unsigned long color, int x, int y, unsigned w, unsigned h);
+extern void render_blit(render_frame_t *fr, const unsigned int *pixels, unsigned w, unsigned h, int x, int y);
+extern void render_blitindexed(render_frame_t *fr, const void *indices, unsigned isize, const unsigned int *palette,
+			       unsigned stride, unsigned w, unsigned h, int x, int y, render_sprite_t *sprite);
+extern int render_loadsprite(render_frame_t *fr, const void *indices, unsigned isize, const unsigned int *palette,
+			     unsigned stride, unsigned w, unsigned h, render_sprite_t *sprite);
+extern void render_freesprite(render_sprite_t *sprite);
+extern int render_movesprite(render_frame_t *fr, render_sprite_t *sprite, int x, int y);
+extern void render_read(render_frame_t *fr, unsigned int *pixels, int x, int y, unsigned w, unsigned h);
+extern void render_polygon(render_frame_t *fr, unsigned long color, XPoint *points, int npoints);
+extern void render_text(render_frame_t *fr, unsigned long fg, unsigned long bg,
+			int x, int y, const char *str, int len);
+extern void render_damage(render_frame_t *fr, int x, int y, unsigned w, unsigned h);
+extern void render_invalidate(render_frame_t *fr, int x, int y, unsigned w, unsigned h);
+extern void render_showlayer(render_frame_t *fr, unsigned depth, render_frame_t *layer, int x, int y);
+extern void render_overlay(render_frame_t *fr, render_frame_t *layer, int x, int y);
+extern void render_flush(render_frame_t *fr);
+extern void render_finish(render_frame_t *fr);
+#endif
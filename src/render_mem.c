@@ -0,0 +1,300 @@
+/*
+ * render_mem.c: backend that keeps frames in memory and dumps them to PNG files
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+#include "render.h"
+
+#define MEMFNT_WIDTH		6
+#define MEMFNT_ASCENT		10
+#define MEMFNT_DESCENT		3
+#define MEMFNT_ROWS		7	// Rows of each glyph of memfont[]
+#define MEMFNT_TOP		3	// First row of the cell where glyphs are drawn
+
+/*
+ * 5x7 glyphs of the printable ASCII characters, one byte per row with the
+ * leftmost pixel in bit 4. It stands for the font of the X server when there
+ * is none, so that text is still rendered by frames kept in memory.
+ */
+static const unsigned char memfont[RENDER_NGLYPHS][MEMFNT_ROWS] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// ' '
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },	// '!'
+	{ 0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00 },	// '"'
+	{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a },	// '#'
+	{ 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 },	// '$'
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },	// '%'
+	{ 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d },	// '&'
+	{ 0x0c, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 },	// '''
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },	// '('
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },	// ')'
+	{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 },	// '*'
+	{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 },	// '+'
+	{ 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08 },	// ','
+	{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 },	// '-'
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c },	// '.'
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },	// '/'
+	{ 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e },	// '0'
+	{ 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e },	// '1'
+	{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f },	// '2'
+	{ 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e },	// '3'
+	{ 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 },	// '4'
+	{ 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e },	// '5'
+	{ 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e },	// '6'
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },	// '7'
+	{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e },	// '8'
+	{ 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c },	// '9'
+	{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 },	// ':'
+	{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 },	// ';'
+	{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },	// '<'
+	{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 },	// '='
+	{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },	// '>'
+	{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },	// '?'
+	{ 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e },	// '@'
+	{ 0x0e, 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11 },	// 'A'
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e },	// 'B'
+	{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e },	// 'C'
+	{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c },	// 'D'
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f },	// 'E'
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 },	// 'F'
+	{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f },	// 'G'
+	{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },	// 'H'
+	{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e },	// 'I'
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c },	// 'J'
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },	// 'K'
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f },	// 'L'
+	{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 },	// 'M'
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },	// 'N'
+	{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },	// 'O'
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 },	// 'P'
+	{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d },	// 'Q'
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 },	// 'R'
+	{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e },	// 'S'
+	{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },	// 'T'
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },	// 'U'
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 },	// 'V'
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a },	// 'W'
+	{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 },	// 'X'
+	{ 0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04 },	// 'Y'
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f },	// 'Z'
+	{ 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e },	// '['
+	{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },	// '\'
+	{ 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e },	// ']'
+	{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 },	// '^'
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f },	// '_'
+	{ 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 },	// '`'
+	{ 0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f },	// 'a'
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e },	// 'b'
+	{ 0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e },	// 'c'
+	{ 0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f },	// 'd'
+	{ 0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e },	// 'e'
+	{ 0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08 },	// 'f'
+	{ 0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e },	// 'g'
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 },	// 'h'
+	{ 0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e },	// 'i'
+	{ 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c },	// 'j'
+	{ 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 },	// 'k'
+	{ 0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e },	// 'l'
+	{ 0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11 },	// 'm'
+	{ 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 },	// 'n'
+	{ 0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e },	// 'o'
+	{ 0x00, 0x00, 0x1e, 0x11, 0x1e, 0x10, 0x10 },	// 'p'
+	{ 0x00, 0x00, 0x0d, 0x13, 0x0f, 0x01, 0x01 },	// 'q'
+	{ 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 },	// 'r'
+	{ 0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e },	// 's'
+	{ 0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06 },	// 't'
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d },	// 'u'
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04 },	// 'v'
+	{ 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a },	// 'w'
+	{ 0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11 },	// 'x'
+	{ 0x00, 0x00, 0x11, 0x11, 0x0f, 0x01, 0x0e },	// 'y'
+	{ 0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f },	// 'z'
+	{ 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02 },	// '{'
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },	// '|'
+	{ 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08 },	// '}'
+	{ 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00 },	// '~'
+};
+
+static void render_mem_present(render_frame_t *fr, render_rect_t *r);
+
+static const render_backend_t render_mem_backend = {
+	"memory",
+	render_mem_present,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+/*
+ *
+ * Nothing has to be sent anywhere: the shadow of a frame kept in memory is
+ * already the framebuffer it displays. The request that the X11 backend
+ * would have issued without MIT-SHM is counted, though, so that benchmarks
+ * run without a server still report it.
+ *
+ */
+static void render_mem_present(render_frame_t *fr, render_rect_t *r)
+{
+	fr->requests++;
+}
+
+/*
+ *
+ * Expand the built-in font into the glyphs of @fr, in cells of the same
+ * size as the ones of the default font of the X server.
+ *
+ */
+static void render_mem_loadfont(render_frame_t *fr)
+{
+	unsigned i, x, y, h = MEMFNT_ASCENT + MEMFNT_DESCENT;
+
+
+	fr->glyphs = (unsigned char *)calloc(RENDER_NGLYPHS * MEMFNT_WIDTH * h, sizeof(unsigned char));
+	if (!fr->glyphs)
+		return;
+
+	fr->fnt_width = MEMFNT_WIDTH;
+	fr->fnt_ascent = MEMFNT_ASCENT;
+	fr->fnt_descent = MEMFNT_DESCENT;
+	for (i=0;i<RENDER_NGLYPHS;i++)
+		for (y=0;y<MEMFNT_ROWS;y++)
+			for (x=0;x<5;x++)
+				fr->glyphs[(i * h + MEMFNT_TOP + y) * MEMFNT_WIDTH + x] =
+					(memfont[i][y] >> (4 - x)) & 1;
+}
+
+/*
+ *
+ * Create a frame of @width x @height pixels which is not shown anywhere but
+ * kept in memory, e.g., to render the game without an X server. Its whole
+ * area is damaged, so that the first flush fills the framebuffer, which can
+ * then be written to a file with render_savepng().
+ * Return NULL on allocation errors.
+ *
+ */
+render_frame_t *render_newframe_mem(unsigned width, unsigned height)
+{
+	render_frame_t *fr = NULL;
+
+
+	fr = render_initframe(&render_mem_backend, width, height, NULL);
+	if (!fr)
+		return NULL;
+
+	render_mem_loadfont(fr);
+	render_damage(fr, 0, 0, width, height);
+
+	return fr;
+}
+
+/*
+ *
+ * Create a frame of @width x @height pixels to be shown on top of @fr with
+ * render_overlay(). It is scaled as @fr, so that it takes as many pixels as
+ * needed. Text is drawn on it with the same font as on @fr.
+ * Return NULL on allocation errors.
+ *
+ */
+render_frame_t *render_newlayer(render_frame_t *fr, unsigned width, unsigned height)
+{
+	render_frame_t *layer = NULL;
+	unsigned n;
+
+
+	layer = render_initframe(&render_mem_backend, render_scaled(fr, width), render_scaled(fr, height), NULL);
+	if (!layer)
+		return NULL;
+
+	layer->vwidth = width;
+	layer->vheight = height;
+	layer->scale = fr->scale;
+	if (!fr->glyphs)
+		return layer;
+
+	n = RENDER_NGLYPHS * fr->fnt_width * (fr->fnt_ascent + fr->fnt_descent);
+	layer->glyphs = (unsigned char *)calloc(n, sizeof(unsigned char));
+	if (layer->glyphs) {
+		memcpy(layer->glyphs, fr->glyphs, n);
+		layer->fnt_width = fr->fnt_width;
+		layer->fnt_ascent = fr->fnt_ascent;
+		layer->fnt_descent = fr->fnt_descent;
+	}
+
+	return layer;
+}
+
+/*
+ *
+ * Write what the frame @fr displays, as of its last flush, to the RGB png-image
+ * @filename. Areas which have never been flushed come out black.
+ * Return 0 on success or -1 if the file could not be written.
+ *
+ */
+int render_savepng(render_frame_t *fr, const char *filename)
+{
+	FILE *fp = NULL;
+	png_structp png_ptr = NULL;
+	png_infop info_ptr = NULL;
+	png_bytep row = NULL;
+	unsigned x, y;
+	unsigned int pixel;
+
+
+	fp = fopen(filename, "wb");
+	if (!fp) {
+		perror(filename);
+		return -1;
+	}
+
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (png_ptr)
+		info_ptr = png_create_info_struct(png_ptr);
+	row = (png_bytep)calloc(fr->width, 3);
+	if (!png_ptr || !info_ptr || !row || setjmp(png_jmpbuf(png_ptr))) {
+		printf("Could not write %s\n", filename);
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		free(row);
+		fclose(fp);
+		return -1;
+	}
+
+	png_init_io(png_ptr, fp);
+	png_set_IHDR(png_ptr, info_ptr, fr->width, fr->height, 8, PNG_COLOR_TYPE_RGB,
+		     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png_ptr, info_ptr);
+	for (y=0;y<fr->height;y++) {
+		for (x=0;x<fr->width;x++) {
+			pixel = fr->shadow[y * fr->width + x];
+			row[x * 3 + 0] = pixel >> 16;
+			row[x * 3 + 1] = pixel >> 8;
+			row[x * 3 + 2] = pixel;
+		}
+		png_write_row(png_ptr, row);
+	}
+	png_write_end(png_ptr, NULL);
+
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	free(row);
+	fclose(fp);
+	return 0;
+}
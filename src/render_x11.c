@@ -0,0 +1,1100 @@
+/*
+ * render_x11.c: backend that shows frames on an X window
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#if defined(HAVE_MIT_SHM)
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
+#if defined(HAVE_XRENDER)
+#include <X11/extensions/Xrender.h>
+#endif
+#include "render.h"
+
+#define RENDER_X11_SPRITES	64
+#define RENDER_X11_QUEUE	256		// Commands the game can be ahead of the render thread
+#define RENDER_X11_INFLIGHT	4		// Frames worth of pixels those commands can hold
+
+/*
+ *
+ * Commands the game queues for the render thread, which is the only one
+ * talking to the server through the connection of the backend. @pixels, if
+ * any, is a copy of what is to be sent, @size bytes long, freed by the
+ * render thread once the command has been run.
+ *
+ */
+typedef enum {
+	RENDER_X11_PRESENT=0,		// Send the rectangle @r, whose pixels are @pixels
+	RENDER_X11_FLUSH,
+	RENDER_X11_UPLOAD,		// Upload @pixels, @r.x1 x @r.y1, as the sprite @slot
+	RENDER_X11_SPRITE,		// Show the sprite @slot at @r, or hide it if @slot is RENDER_X11_SPRITES
+	RENDER_X11_RESIZE,		// Replace the image with one of @r.x1 x @r.y1 pixels
+	RENDER_X11_QUIT
+} render_x11_op_t;
+
+typedef struct render_x11_cmd_st {
+	render_x11_op_t op;
+	render_rect_t r;
+	unsigned slot;
+	unsigned int *pixels;
+	unsigned long long size;
+} render_x11_cmd_t;
+
+typedef struct render_x11_st {
+	// owned by the render thread once it is started
+	Display *dy;			// Connection of its own, apart from the one of the game
+	Window win;
+	GC gc;
+	XImage *image;			// Image pixels are sent through
+	boolean_t shm;
+	boolean_t direct;		// Whether pixels are copied into the image as they are
+#if defined(HAVE_MIT_SHM)
+	XShmSegmentInfo shminfo;
+	unsigned long attach;		// Serial of the XShmAttach() being checked, 0 if none
+	boolean_t attachfailed;
+#endif
+#if defined(HAVE_XRENDER)
+	XRenderPictFormat *format;	// Format of the window, NULL if the extension is missing
+	Picture winpic;
+	Pixmap back;			// What was presented, from which the window is restored
+	render_rect_t moving;		// Where the sprite is shown, empty if nowhere
+	struct {
+		Pixmap pixmap;
+		Picture picture;
+	} sprites[RENDER_X11_SPRITES];	// Sprites uploaded to the server, None if the upload failed
+
+	// owned by the game
+	boolean_t canmove;		// Whether sprites can be moved by the server
+	struct {
+		const render_sprite_t *sprite;
+		unsigned scale;
+	} uploaded[RENDER_X11_SPRITES];	// What each sprite on the server was uploaded from
+	unsigned nextsprite;		// Entry replaced when all of them are in use
+#endif
+	unsigned long long budget;	// Bytes of pixels queued at most, see RENDER_X11_INFLIGHT
+
+	// shared, under @mutex
+	pthread_t thread;
+	boolean_t started;
+	pthread_mutex_t mutex;
+	pthread_cond_t ready;		// Signaled when a command is queued
+	pthread_cond_t done;		// Broadcast when a command has been run
+	render_x11_cmd_t queue[RENDER_X11_QUEUE];
+	unsigned head;			// Command running, or to be run next
+	unsigned count;			// Commands queued, the running one included
+	unsigned long long inflight;	// Bytes of pixels they hold
+	unsigned long requests;		// Requests issued since the game last collected them
+	int result;			// What the last resize returned
+	boolean_t dead;			// Whether the window or the connection is gone, after which nothing is sent
+	boolean_t stopped;		// Whether the render thread has left, which it does once dead
+	boolean_t joining;		// Whether the game is to join it, otherwise it detaches itself when leaving
+
+	struct render_x11_st *next;	// Next one in the list the error handlers look up, under connections_mutex
+} render_x11_t;
+
+static void render_x11_present(render_frame_t *fr, render_rect_t *r);
+static void render_x11_flush(render_frame_t *fr);
+static void render_x11_destroy(render_frame_t *fr);
+static int render_x11_resize(render_frame_t *fr, unsigned width, unsigned height, unsigned int **shadow);
+#if defined(HAVE_XRENDER)
+static int render_x11_sprite(render_frame_t *fr, render_sprite_t *sprite, int x, int y);
+#endif
+static void render_x11_finish(render_frame_t *fr);
+static void render_x11_queue(render_x11_t *x11, render_x11_cmd_t *cmd);
+
+static const render_backend_t render_x11_backend = {
+	"x11",
+	render_x11_present,
+	render_x11_flush,
+	render_x11_destroy,
+	render_x11_resize,
+#if defined(HAVE_XRENDER)
+	render_x11_sprite,
+#else
+	NULL,
+#endif
+	render_x11_finish
+};
+
+static pthread_mutex_t connections_mutex = PTHREAD_MUTEX_INITIALIZER;
+static render_x11_t *connections = NULL;	// Backends whose connection the handlers below look after
+static int (*prev_handler)(Display *, XErrorEvent *) = NULL;
+static int (*prev_iohandler)(Display *) = NULL;
+
+/*
+ *
+ * Return the backend whose connection is @dy, or NULL if @dy is the
+ * connection of the game.
+ *
+ */
+static render_x11_t *render_x11_lookup(Display *dy)
+{
+	render_x11_t *x11;
+
+
+	pthread_mutex_lock(&connections_mutex);
+	for (x11=connections;x11 && x11->dy!=dy;x11=x11->next);
+	pthread_mutex_unlock(&connections_mutex);
+
+	return x11;
+}
+
+/*
+ *
+ * Throw away what is queued for the render thread of @x11, which is leaving
+ * because its window or its connection is gone, and wake up the game if it
+ * is waiting for it. Called by the render thread with the mutex held.
+ *
+ */
+static void render_x11_drain(render_x11_t *x11)
+{
+	if (!x11->joining)
+		pthread_detach(pthread_self());
+
+	while (x11->count) {
+		free(x11->queue[x11->head].pixels);
+		x11->head = (x11->head + 1) % RENDER_X11_QUEUE;
+		x11->count--;
+	}
+	x11->inflight = 0;
+	x11->dead = TRUE;
+	x11->stopped = TRUE;
+	pthread_cond_broadcast(&x11->done);
+}
+
+/*
+ *
+ * Handler of the errors of every connection, since Xlib has only one for the
+ * whole process. Errors of the connection of the game are left to the
+ * handler it had. On the connection of a backend, a failed XShmAttach() is
+ * recorded for render_shm_image(), and an error on the window means that it
+ * has been destroyed, so the backend is marked dead and its render thread
+ * leaves instead of the whole game exiting from it. Other errors are only
+ * reported.
+ *
+ */
+static int render_x11_error(Display *dy, XErrorEvent *ev)
+{
+	render_x11_t *x11 = render_x11_lookup(dy);
+
+
+	if (!x11)
+		return prev_handler ? prev_handler(dy, ev) : 0;
+
+#if defined(HAVE_MIT_SHM)
+	if (x11->attach && ev->serial == x11->attach) {
+		x11->attachfailed = TRUE;
+		return 0;
+	}
+#endif
+#if defined(HAVE_XRENDER)
+	if (x11->winpic && ev->resourceid == x11->winpic)
+		goto fndead;
+#endif
+	if (ev->resourceid == x11->win)
+		goto fndead;
+
+	printf("X error %d on request %d.%d sent by the render thread\n",
+	       ev->error_code, ev->request_code, ev->minor_code);
+	return 0;
+
+fndead:
+	pthread_mutex_lock(&x11->mutex);
+	x11->dead = TRUE;
+	pthread_cond_broadcast(&x11->done);
+	pthread_mutex_unlock(&x11->mutex);
+	return 0;
+}
+
+/*
+ *
+ * Handler of fatal errors of every connection, e.g., when the server goes
+ * away. Xlib exits once it returns, so if the connection of a backend is
+ * lost on its render thread, the thread leaves right from here, after
+ * marking the backend dead, and the game is left to find out on its own
+ * connection.
+ *
+ */
+static int render_x11_ioerror(Display *dy)
+{
+	render_x11_t *x11 = render_x11_lookup(dy);
+	boolean_t mine = FALSE;
+
+
+	if (x11) {
+		pthread_mutex_lock(&x11->mutex);
+		mine = x11->started && pthread_equal(x11->thread, pthread_self()) ? TRUE : FALSE;
+		if (mine)
+			render_x11_drain(x11);
+		pthread_mutex_unlock(&x11->mutex);
+	}
+	if (mine)
+		pthread_exit(NULL);
+
+	return prev_iohandler ? prev_iohandler(dy) : 0;
+}
+
+/*
+ *
+ * Let the error handlers look after the connection of @x11, installing them
+ * the first time. This is done before the render thread is started, and the
+ * handlers are never swapped afterwards, so that the game can keep using
+ * its own connection meanwhile.
+ *
+ */
+static void render_x11_watch(render_x11_t *x11)
+{
+	pthread_mutex_lock(&connections_mutex);
+	if (!connections && !prev_handler) {
+		prev_handler = XSetErrorHandler(render_x11_error);
+		prev_iohandler = XSetIOErrorHandler(render_x11_ioerror);
+	}
+	x11->next = connections;
+	connections = x11;
+	pthread_mutex_unlock(&connections_mutex);
+}
+
+static void render_x11_unwatch(render_x11_t *x11)
+{
+	render_x11_t **p;
+
+
+	pthread_mutex_lock(&connections_mutex);
+	for (p=&connections;*p && *p!=x11;p=&(*p)->next);
+	if (*p)
+		*p = x11->next;
+	pthread_mutex_unlock(&connections_mutex);
+}
+
+#if defined(HAVE_MIT_SHM)
+/*
+ *
+ * Try to create an image of @width x @height pixels in a shared memory segment.
+ * The segment is marked for removal as soon as the X server is attached to
+ * it, so that it is released even if the game does not exit cleanly.
+ * Return NULL if the extension is missing or the server cannot attach the
+ * segment (e.g., when the display is remote).
+ *
+ */
+static XImage *render_shm_image(render_x11_t *x11, Visual *visual, int depth, unsigned width, unsigned height)
+{
+	XImage *image = NULL;
+
+
+	if (!XShmQueryExtension(x11->dy))
+		return NULL;
+
+	image = XShmCreateImage(x11->dy, visual, depth, ZPixmap, NULL, &x11->shminfo, width, height);
+	if (!image)
+		return NULL;
+
+	x11->shminfo.shmid = shmget(IPC_PRIVATE, image->bytes_per_line * image->height, IPC_CREAT|0600);
+	if (x11->shminfo.shmid == -1) {
+		XDestroyImage(image);
+		return NULL;
+	}
+
+	x11->shminfo.shmaddr = image->data = (char *)shmat(x11->shminfo.shmid, NULL, 0);
+	if (x11->shminfo.shmaddr == (char *)-1) {
+		shmctl(x11->shminfo.shmid, IPC_RMID, NULL);
+		image->data = NULL;
+		XDestroyImage(image);
+		return NULL;
+	}
+	x11->shminfo.readOnly = False;
+
+	// a failure is caught by render_x11_error() from the serial of the request
+	x11->attachfailed = FALSE;
+	x11->attach = NextRequest(x11->dy);
+	XShmAttach(x11->dy, &x11->shminfo);
+	XSync(x11->dy, False);
+	x11->attach = 0;
+	shmctl(x11->shminfo.shmid, IPC_RMID, NULL);
+
+	if (x11->attachfailed) {
+		shmdt(x11->shminfo.shmaddr);
+		image->data = NULL;
+		XDestroyImage(image);
+		return NULL;
+	}
+
+	return image;
+}
+#endif
+
+/*
+ *
+ * Render the printable characters of the font of the GC of @x11 once, so that
+ * text can be drawn on the back buffer of @fr. The font is assumed to have
+ * fixed width, as the default font of the server does. If anything fails,
+ * text is drawn as blank boxes.
+ *
+ */
+static void render_loadfont(render_frame_t *fr, render_x11_t *x11)
+{
+	XFontStruct *fs = NULL;
+	XImage *image = NULL;
+	Pixmap pixmap;
+	GC gc;
+	char chars[RENDER_NGLYPHS];
+	unsigned i, x, y, h;
+
+
+	fs = XQueryFont(x11->dy, XGContextFromGC(x11->gc));
+	if (!fs)
+		return;
+
+	fr->fnt_width = fs->max_bounds.width;
+	fr->fnt_ascent = fs->ascent;
+	fr->fnt_descent = fs->descent;
+	XFreeFontInfo(NULL, fs, 1);
+	h = fr->fnt_ascent + fr->fnt_descent;
+	if (fr->fnt_width == 0 || h == 0)
+		return;
+
+	for (i=0;i<RENDER_NGLYPHS;i++)
+		chars[i] = RENDER_FIRST_GLYPH + i;
+
+	pixmap = XCreatePixmap(x11->dy, x11->win, RENDER_NGLYPHS * fr->fnt_width, h, 1);
+	gc = XCreateGC(x11->dy, pixmap, 0, NULL);
+	XSetForeground(x11->dy, gc, 1);
+	XSetBackground(x11->dy, gc, 0);
+	XDrawImageString(x11->dy, pixmap, gc, 0, fr->fnt_ascent, chars, RENDER_NGLYPHS);
+	image = XGetImage(x11->dy, pixmap, 0, 0, RENDER_NGLYPHS * fr->fnt_width, h, 1, XYPixmap);
+	XFreeGC(x11->dy, gc);
+	XFreePixmap(x11->dy, pixmap);
+	if (!image)
+		return;
+
+	fr->glyphs = (unsigned char *)calloc(RENDER_NGLYPHS * fr->fnt_width * h, sizeof(unsigned char));
+	if (fr->glyphs) {
+		for (i=0;i<RENDER_NGLYPHS;i++)
+			for (y=0;y<h;y++)
+				for (x=0;x<fr->fnt_width;x++)
+					fr->glyphs[(i * h + y) * fr->fnt_width + x] =
+						XGetPixel(image, i * fr->fnt_width + x, y) ? 1 : 0;
+	}
+	XDestroyImage(image);
+}
+
+#if defined(HAVE_XRENDER)
+/*
+ *
+ * Set up the XRender extension for the window of @x11, so that sprites can be
+ * composited on it by the server. The format stays NULL if the extension is
+ * missing, in which case sprites are drawn by the client.
+ *
+ */
+static void render_xrender_init(render_x11_t *x11)
+{
+	Visual *visual;
+	int event, error;
+
+
+	if (!XRenderQueryExtension(x11->dy, &event, &error))
+		return;
+
+	visual = XDefaultVisual(x11->dy, XDefaultScreen(x11->dy));
+	x11->format = XRenderFindVisualFormat(x11->dy, visual);
+	if (x11->format)
+		x11->winpic = XRenderCreatePicture(x11->dy, x11->win, x11->format, 0, NULL);
+}
+
+/*
+ *
+ * Free the sprites uploaded to the server and the pixmap the window is
+ * restored from, e.g., before the window is resized.
+ *
+ */
+static void render_xrender_free(render_x11_t *x11)
+{
+	unsigned i;
+
+
+	for (i=0;i<RENDER_X11_SPRITES;i++) {
+		if (x11->sprites[i].picture)
+			XRenderFreePicture(x11->dy, x11->sprites[i].picture);
+		if (x11->sprites[i].pixmap)
+			XFreePixmap(x11->dy, x11->sprites[i].pixmap);
+		x11->sprites[i].picture = None;
+		x11->sprites[i].pixmap = None;
+	}
+	if (x11->back)
+		XFreePixmap(x11->dy, x11->back);
+	x11->back = None;
+	x11->moving.x0 = x11->moving.x1 = 0;
+}
+
+/*
+ *
+ * Upload the @cmd->r.x1 x @cmd->r.y1 pixels of @cmd as the sprite
+ * @cmd->slot, replacing whatever it was. Pixels are converted to the visual
+ * of the window once, then every move is composited by the server. If
+ * anything fails, the sprite is left as None and is not shown.
+ *
+ */
+static void render_xrender_upload(render_x11_t *x11, render_x11_cmd_t *cmd)
+{
+	XImage *image = NULL;
+	unsigned x, y, width = cmd->r.x1, height = cmd->r.y1;
+	int depth;
+
+
+	if (x11->sprites[cmd->slot].picture)
+		XRenderFreePicture(x11->dy, x11->sprites[cmd->slot].picture);
+	if (x11->sprites[cmd->slot].pixmap)
+		XFreePixmap(x11->dy, x11->sprites[cmd->slot].pixmap);
+	x11->sprites[cmd->slot].picture = None;
+	x11->sprites[cmd->slot].pixmap = None;
+
+	depth = XDefaultDepth(x11->dy, XDefaultScreen(x11->dy));
+	image = XCreateImage(x11->dy, XDefaultVisual(x11->dy, XDefaultScreen(x11->dy)), depth, ZPixmap, 0, NULL,
+			     width, height, 32, 0);
+	if (!image)
+		return;
+	image->data = (char *)malloc(image->bytes_per_line * height);
+	if (!image->data) {
+		XDestroyImage(image);
+		return;
+	}
+	for (y=0;y<height;y++)
+		for (x=0;x<width;x++)
+			XPutPixel(image, x, y, cmd->pixels[y * width + x]);
+
+	x11->sprites[cmd->slot].pixmap = XCreatePixmap(x11->dy, x11->win, width, height, depth);
+	XPutImage(x11->dy, x11->sprites[cmd->slot].pixmap, x11->gc, image, 0, 0, 0, 0, width, height);
+	XDestroyImage(image);
+	x11->sprites[cmd->slot].picture = XRenderCreatePicture(x11->dy, x11->sprites[cmd->slot].pixmap,
+							       x11->format, 0, NULL);
+}
+#endif
+
+/*
+ *
+ * Free the image of @x11, detaching its shared memory segment if any.
+ *
+ */
+static void render_x11_freeimage(render_x11_t *x11)
+{
+	if (!x11->image)
+		return;
+
+#if defined(HAVE_MIT_SHM)
+	if (x11->shm) {
+		XShmDetach(x11->dy, &x11->shminfo);
+		XSync(x11->dy, False);
+		shmdt(x11->shminfo.shmaddr);
+		x11->image->data = NULL;
+	}
+#endif
+	XDestroyImage(x11->image);
+	x11->image = NULL;
+	x11->shm = FALSE;
+}
+
+/*
+ *
+ * Stop the render thread of @x11, if started, once it has run what was
+ * queued, then free everything it owns and close its connection. If the
+ * thread has already left because the window or the connection is gone,
+ * nothing is queued or sent to the server any more: only what the client
+ * holds is freed.
+ *
+ */
+static void render_x11_free(render_x11_t *x11)
+{
+	render_x11_cmd_t cmd = { RENDER_X11_QUIT, { 0, 0, 0, 0 }, 0, NULL, 0 };
+	boolean_t stopped;
+
+
+	pthread_mutex_lock(&x11->mutex);
+	stopped = x11->stopped;
+	x11->joining = x11->started && !stopped ? TRUE : FALSE;
+	pthread_mutex_unlock(&x11->mutex);
+	if (x11->joining) {
+		render_x11_queue(x11, &cmd);
+		pthread_join(x11->thread, NULL);
+	}
+	render_x11_unwatch(x11);
+	pthread_cond_destroy(&x11->done);
+	pthread_cond_destroy(&x11->ready);
+	pthread_mutex_destroy(&x11->mutex);
+
+	if (x11->dead) {
+		if (x11->image) {
+#if defined(HAVE_MIT_SHM)
+			if (x11->shm) {
+				shmdt(x11->shminfo.shmaddr);
+				x11->image->data = NULL;
+			}
+#endif
+			XDestroyImage(x11->image);
+		}
+		free(x11);
+		return;
+	}
+
+	render_x11_freeimage(x11);
+#if defined(HAVE_XRENDER)
+	render_xrender_free(x11);
+	if (x11->winpic)
+		XRenderFreePicture(x11->dy, x11->winpic);
+#endif
+	if (x11->gc)
+		XFreeGC(x11->dy, x11->gc);
+	XCloseDisplay(x11->dy);
+	free(x11);
+}
+
+/*
+ *
+ * Create the image of @x11 for @width x @height pixels, in shared memory if
+ * possible. Return 0 on success or -1 if the image could not be created, in
+ * which case the image of @x11 is NULL.
+ *
+ */
+static int render_x11_newimage(render_x11_t *x11, unsigned width, unsigned height)
+{
+	Visual *visual;
+	int depth, endian = 1;
+	boolean_t direct;
+
+
+	visual = XDefaultVisual(x11->dy, XDefaultScreen(x11->dy));
+	depth = XDefaultDepth(x11->dy, XDefaultScreen(x11->dy));
+	direct = visual->class == TrueColor && visual->red_mask == 0xff0000 &&
+		 visual->green_mask == 0x00ff00 && visual->blue_mask == 0x0000ff ? TRUE : FALSE;
+
+#if defined(HAVE_MIT_SHM)
+	if (direct) {
+		x11->image = render_shm_image(x11, visual, depth, width, height);
+		if (x11->image)
+			x11->shm = TRUE;
+	}
+#endif
+	if (!x11->image) {
+		x11->image = XCreateImage(x11->dy, visual, depth, ZPixmap, 0, NULL, width, height, 32, 0);
+		if (x11->image) {
+			x11->image->data = (char *)calloc(x11->image->bytes_per_line, height);
+			if (!x11->image->data) {
+				XDestroyImage(x11->image);
+				x11->image = NULL;
+			}
+		}
+	}
+	if (!x11->image)
+		return -1;
+
+#if defined(HAVE_XRENDER)
+	if (x11->format)
+		x11->back = XCreatePixmap(x11->dy, x11->win, width, height, depth);
+#endif
+	x11->direct = direct && x11->image->bits_per_pixel == 32 &&
+		      x11->image->byte_order == (*(char *)&endian ? LSBFirst : MSBFirst) ? TRUE : FALSE;
+
+	return 0;
+}
+
+/*
+ *
+ * Copy the pixels of @cmd into the rectangle @cmd->r of the image of @x11,
+ * then send it to the window. The transfer is done through the shared
+ * memory segment when available, in which case the server is synchronized
+ * so that the image can be safely overwritten by the next command. If the
+ * window is restored from a pixmap, the rectangle is sent to the latter and
+ * copied from there by the server.
+ *
+ */
+static void render_x11_send(render_x11_t *x11, render_x11_cmd_t *cmd)
+{
+	render_rect_t *r = &cmd->r;
+	unsigned w = r->x1 - r->x0;
+	Drawable dst = x11->win;
+	int i, j;
+
+
+	for (i=r->y0;i<r->y1;i++) {
+		if (x11->direct) {
+			memcpy(x11->image->data + i * x11->image->bytes_per_line + r->x0 * sizeof(unsigned int),
+			       cmd->pixels + (i - r->y0) * w, w * sizeof(unsigned int));
+			continue;
+		}
+		for (j=r->x0;j<r->x1;j++)
+			XPutPixel(x11->image, j, i, cmd->pixels[(i - r->y0) * w + j - r->x0]);
+	}
+
+#if defined(HAVE_XRENDER)
+	if (x11->back)
+		dst = x11->back;
+#endif
+#if defined(HAVE_MIT_SHM)
+	if (x11->shm)
+		XShmPutImage(x11->dy, dst, x11->gc, x11->image, r->x0, r->y0, r->x0, r->y0,
+			     r->x1 - r->x0, r->y1 - r->y0, False);
+	else
+#endif
+		XPutImage(x11->dy, dst, x11->gc, x11->image, r->x0, r->y0, r->x0, r->y0,
+			  r->x1 - r->x0, r->y1 - r->y0);
+	if (dst != x11->win)
+		XCopyArea(x11->dy, dst, x11->win, x11->gc, r->x0, r->y0,
+			  r->x1 - r->x0, r->y1 - r->y0, r->x0, r->y0);
+#if defined(HAVE_MIT_SHM)
+	if (x11->shm)
+		XSync(x11->dy, False);
+#endif
+}
+
+#if defined(HAVE_XRENDER)
+/*
+ *
+ * Copy the part of the rectangle @r of the pixmap the window of @x11 is
+ * restored from which is not covered by @keep back onto the window, as up
+ * to four bands around @keep.
+ *
+ */
+static void render_xrender_restore(render_x11_t *x11, render_rect_t *r, render_rect_t *keep)
+{
+	render_rect_t band[4];
+	int i, y0, y1;
+
+
+	if (r->x0 >= r->x1)
+		return;
+
+	if (keep->x0 >= keep->x1 || keep->x0 >= r->x1 || keep->x1 <= r->x0 ||
+	    keep->y0 >= r->y1 || keep->y1 <= r->y0) {
+		XCopyArea(x11->dy, x11->back, x11->win, x11->gc, r->x0, r->y0,
+			  r->x1 - r->x0, r->y1 - r->y0, r->x0, r->y0);
+		return;
+	}
+
+	y0 = keep->y0 > r->y0 ? keep->y0 : r->y0;
+	y1 = keep->y1 < r->y1 ? keep->y1 : r->y1;
+	band[0] = (render_rect_t){ r->x0, r->y0, r->x1, y0 };
+	band[1] = (render_rect_t){ r->x0, y1, r->x1, r->y1 };
+	band[2] = (render_rect_t){ r->x0, y0, keep->x0, y1 };
+	band[3] = (render_rect_t){ keep->x1, y0, r->x1, y1 };
+	for (i=0;i<4;i++)
+		if (band[i].x0 < band[i].x1 && band[i].y0 < band[i].y1)
+			XCopyArea(x11->dy, x11->back, x11->win, x11->gc, band[i].x0, band[i].y0,
+				  band[i].x1 - band[i].x0, band[i].y1 - band[i].y0, band[i].x0, band[i].y0);
+}
+
+/*
+ *
+ * Composite the sprite @cmd->slot on the window of @x11 at @cmd->r, then put
+ * back from the pixmap of what was presented the part of the previous
+ * position that the sprite no longer covers. Once the sprite has been
+ * uploaded, a move costs a handful of requests and no pixels go through the
+ * client.
+ *
+ */
+static void render_xrender_move(render_x11_t *x11, render_x11_cmd_t *cmd)
+{
+	render_rect_t r = { 0, 0, 0, 0 };
+	Picture picture = None;
+
+
+	if (cmd->slot < RENDER_X11_SPRITES)
+		picture = x11->sprites[cmd->slot].picture;
+	if (picture) {
+		r = cmd->r;
+		XRenderComposite(x11->dy, PictOpOver, picture, None, x11->winpic, 0, 0, 0, 0,
+				 r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0);
+	}
+	render_xrender_restore(x11, &x11->moving, &r);
+	x11->moving = r;
+
+	XFlush(x11->dy);
+}
+#endif
+
+/*
+ *
+ * Run @cmd on the connection of @x11. Return what a resize returns, 0 for
+ * any other command.
+ *
+ */
+static int render_x11_run(render_x11_t *x11, render_x11_cmd_t *cmd)
+{
+	switch (cmd->op) {
+	case RENDER_X11_PRESENT:
+		render_x11_send(x11, cmd);
+		break;
+	case RENDER_X11_FLUSH:
+		XFlush(x11->dy);
+		break;
+#if defined(HAVE_XRENDER)
+	case RENDER_X11_UPLOAD:
+		render_xrender_upload(x11, cmd);
+		break;
+	case RENDER_X11_SPRITE:
+		render_xrender_move(x11, cmd);
+		break;
+#endif
+	case RENDER_X11_RESIZE:
+		render_x11_freeimage(x11);
+#if defined(HAVE_XRENDER)
+		render_xrender_free(x11);
+#endif
+		return render_x11_newimage(x11, cmd->r.x1, cmd->r.y1);
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ *
+ * Main function of the render thread: run the commands queued for @arg in
+ * order, until told to quit or the backend is dead. Commands stay queued
+ * while they run, so that an empty queue means that everything has been
+ * sent.
+ *
+ */
+static void *render_x11_thread(void *arg)
+{
+	render_x11_t *x11 = (render_x11_t *)arg;
+	render_x11_cmd_t cmd;
+	unsigned long request;
+	boolean_t stopped = FALSE;
+	int ret;
+
+
+	do {
+		pthread_mutex_lock(&x11->mutex);
+		while (!x11->count && !x11->dead)
+			pthread_cond_wait(&x11->ready, &x11->mutex);
+		if (x11->dead) {
+			render_x11_drain(x11);
+			pthread_mutex_unlock(&x11->mutex);
+			break;
+		}
+		cmd = x11->queue[x11->head];
+		pthread_mutex_unlock(&x11->mutex);
+
+		request = NextRequest(x11->dy);
+		ret = render_x11_run(x11, &cmd);
+		free(cmd.pixels);
+
+		pthread_mutex_lock(&x11->mutex);
+		x11->head = (x11->head + 1) % RENDER_X11_QUEUE;
+		x11->count--;
+		x11->inflight -= cmd.size;
+		x11->requests += NextRequest(x11->dy) - request;
+		if (cmd.op == RENDER_X11_RESIZE)
+			x11->result = ret;
+		if (x11->dead)
+			render_x11_drain(x11);
+		stopped = x11->stopped;
+		pthread_cond_broadcast(&x11->done);
+		pthread_mutex_unlock(&x11->mutex);
+	} while (cmd.op != RENDER_X11_QUIT && !stopped);
+
+	return NULL;
+}
+
+/*
+ *
+ * Queue @cmd for the render thread of @x11, which takes ownership of its
+ * pixels. The caller only waits if the queue is full, or if the pixels it
+ * holds would exceed the budget of @x11, i.e., if the game got too far ahead
+ * of the server. Once @x11 is dead, @cmd is thrown away.
+ *
+ */
+static void render_x11_queue(render_x11_t *x11, render_x11_cmd_t *cmd)
+{
+	pthread_mutex_lock(&x11->mutex);
+	while (!x11->dead &&
+	       (x11->count == RENDER_X11_QUEUE || (x11->count && x11->inflight + cmd->size > x11->budget)))
+		pthread_cond_wait(&x11->done, &x11->mutex);
+	if (x11->dead) {
+		pthread_mutex_unlock(&x11->mutex);
+		free(cmd->pixels);
+		return;
+	}
+	x11->queue[(x11->head + x11->count) % RENDER_X11_QUEUE] = *cmd;
+	x11->count++;
+	x11->inflight += cmd->size;
+	pthread_cond_signal(&x11->ready);
+	pthread_mutex_unlock(&x11->mutex);
+}
+
+/*
+ *
+ * Account in @fr the requests issued by the render thread so far.
+ *
+ */
+static void render_x11_collect(render_frame_t *fr, render_x11_t *x11)
+{
+	pthread_mutex_lock(&x11->mutex);
+	fr->requests += x11->requests;
+	x11->requests = 0;
+	pthread_mutex_unlock(&x11->mutex);
+}
+
+/*
+ *
+ * Create a frame of @width x @height pixels shown on the window @win of the
+ * display @dy. Drawing routines record the areas they touch and
+ * render_flush() sends only those to the server.
+ *
+ * The frame is sent by a render thread, through a connection to the display
+ * of its own: presenting an area queues a copy of its pixels and returns, so
+ * that the game never waits for the server, and Xlib is never called from
+ * two threads on the same connection, so that neither waits for the other.
+ * If the window or the connection goes away, the frame is marked dead and
+ * the thread leaves, see render_x11_error(). The image the
+ * thread sends is allocated in shared memory when the MIT-SHM extension is
+ * available, and when the default visual is 24-bit TrueColor with 32 bits
+ * per pixel in the byte order of the client, pixels are copied into it with
+ * no conversion. With the XRender extension, what is presented is also kept
+ * in a pixmap on the server, so that sprites can be moved over the window
+ * without the client redrawing what they uncover (see render_x11_sprite()).
+ * Return NULL on errors.
+ *
+ */
+render_frame_t *render_newframe_x11(Display *dy, Window win, unsigned width, unsigned height)
+{
+	render_frame_t *fr = NULL;
+	render_x11_t *x11 = NULL;
+
+
+	x11 = (render_x11_t *)calloc(1, sizeof(render_x11_t));
+	if (!x11)
+		return NULL;
+	pthread_mutex_init(&x11->mutex, NULL);
+	pthread_cond_init(&x11->ready, NULL);
+	pthread_cond_init(&x11->done, NULL);
+
+	// the window must exist on the server before another connection uses it
+	XSync(dy, False);
+	x11->dy = XOpenDisplay(DisplayString(dy));
+	if (!x11->dy) {
+		pthread_cond_destroy(&x11->done);
+		pthread_cond_destroy(&x11->ready);
+		pthread_mutex_destroy(&x11->mutex);
+		free(x11);
+		return NULL;
+	}
+	render_x11_watch(x11);
+	x11->win = win;
+	x11->gc = XCreateGC(x11->dy, win, 0, NULL);
+	XSetGraphicsExposures(x11->dy, x11->gc, False);
+#if defined(HAVE_XRENDER)
+	render_xrender_init(x11);
+#endif
+
+	if (render_x11_newimage(x11, width, height)) {
+		render_x11_free(x11);
+		return NULL;
+	}
+#if defined(HAVE_XRENDER)
+	x11->canmove = x11->format && x11->back ? TRUE : FALSE;
+#endif
+	x11->budget = RENDER_X11_INFLIGHT * (unsigned long long)width * height * sizeof(unsigned int);
+
+	fr = render_initframe(&render_x11_backend, width, height, NULL);
+	if (!fr) {
+		render_x11_free(x11);
+		return NULL;
+	}
+	render_loadfont(fr, x11);
+	XSync(x11->dy, False);
+	if (x11->dead) {
+		render_x11_free(x11);
+		render_destroyframe(fr);
+		return NULL;
+	}
+
+	// from now on, only the render thread talks to the server through x11->dy
+	pthread_mutex_lock(&x11->mutex);
+	if (!pthread_create(&x11->thread, NULL, render_x11_thread, x11))
+		x11->started = TRUE;
+	pthread_mutex_unlock(&x11->mutex);
+	if (!x11->started) {
+		render_x11_free(x11);
+		render_destroyframe(fr);
+		return NULL;
+	}
+	fr->data = x11;
+
+	return fr;
+}
+
+/*
+ *
+ * Queue the rectangle @r of the shadow of @fr to be sent to its window. Its
+ * pixels are copied, so that the shadow can be overwritten as soon as this
+ * function returns.
+ *
+ */
+static void render_x11_present(render_frame_t *fr, render_rect_t *r)
+{
+	render_x11_t *x11 = (render_x11_t *)fr->data;
+	render_x11_cmd_t cmd = { RENDER_X11_PRESENT, *r, 0, NULL, 0 };
+	unsigned w = r->x1 - r->x0;
+	int i;
+
+
+	cmd.size = (unsigned long long)w * (r->y1 - r->y0) * sizeof(unsigned int);
+	cmd.pixels = (unsigned int *)malloc(cmd.size);
+	if (!cmd.pixels) {
+		perror("render_x11_present");
+		return;
+	}
+	for (i=r->y0;i<r->y1;i++)
+		memcpy(cmd.pixels + (i - r->y0) * w, fr->shadow + i * fr->width + r->x0, w * sizeof(unsigned int));
+
+	render_x11_queue(x11, &cmd);
+}
+
+static void render_x11_flush(render_frame_t *fr)
+{
+	render_x11_t *x11 = (render_x11_t *)fr->data;
+	render_x11_cmd_t cmd = { RENDER_X11_FLUSH, { 0, 0, 0, 0 }, 0, NULL, 0 };
+
+
+	render_x11_queue(x11, &cmd);
+	render_x11_collect(fr, x11);
+}
+
+/*
+ *
+ * Wait until the render thread has sent everything queued for @fr, and
+ * account the requests it took.
+ *
+ */
+static void render_x11_finish(render_frame_t *fr)
+{
+	render_x11_t *x11 = (render_x11_t *)fr->data;
+
+
+	pthread_mutex_lock(&x11->mutex);
+	while (x11->count && !x11->stopped)
+		pthread_cond_wait(&x11->done, &x11->mutex);
+	pthread_mutex_unlock(&x11->mutex);
+	render_x11_collect(fr, x11);
+}
+
+/*
+ *
+ * Stop the render thread of @fr and free everything it owned.
+ *
+ */
+static void render_x11_destroy(render_frame_t *fr)
+{
+	render_x11_t *x11 = (render_x11_t *)fr->data;
+
+
+	if (!x11)
+		return;
+
+	render_x11_free(x11);
+	fr->data = NULL;
+}
+
+/*
+ *
+ * Let the render thread replace the image of @fr with one of @width x
+ * @height pixels, and wait for it. The shadow is left to the frame, as the
+ * image is never used as such. Sprites uploaded for the previous size are
+ * forgotten.
+ *
+ */
+static int render_x11_resize(render_frame_t *fr, unsigned width, unsigned height, unsigned int **shadow)
+{
+	render_x11_t *x11 = (render_x11_t *)fr->data;
+	render_x11_cmd_t cmd = { RENDER_X11_RESIZE, { 0, 0, width, height }, 0, NULL, 0 };
+
+
+	render_x11_queue(x11, &cmd);
+	render_x11_finish(fr);
+	if (x11->stopped)
+		return 0;
+#if defined(HAVE_XRENDER)
+	memset(x11->uploaded, 0, sizeof(x11->uploaded));
+	x11->nextsprite = 0;
+	x11->canmove = !x11->result && x11->format && x11->back ? TRUE : FALSE;
+#endif
+	x11->budget = RENDER_X11_INFLIGHT * (unsigned long long)width * height * sizeof(unsigned int);
+
+	return x11->result;
+}
+
+#if defined(HAVE_XRENDER)
+/*
+ *
+ * Queue @sprite to be composited on the window of @fr at (@x, @y) by the
+ * server, uploading it first the first time it is shown at its scale, or
+ * queue it to be hidden if @sprite is NULL. Its pixels are copied for the
+ * upload, so that the sprite can be freed or resampled at any time. Return
+ * -1 if the extension is missing or the pixels could not be copied; if the
+ * upload itself fails, the sprite is not shown.
+ *
+ */
+static int render_x11_sprite(render_frame_t *fr, render_sprite_t *sprite, int x, int y)
+{
+	render_x11_t *x11 = (render_x11_t *)fr->data;
+	render_x11_cmd_t cmd = { RENDER_X11_SPRITE, { 0, 0, 0, 0 }, RENDER_X11_SPRITES, NULL, 0 };
+	render_x11_cmd_t upload = { RENDER_X11_UPLOAD, { 0, 0, 0, 0 }, 0, NULL, 0 };
+	unsigned i;
+
+
+	if (!x11->canmove)
+		return -1;
+
+	if (sprite) {
+		for (i=0;i<RENDER_X11_SPRITES;i++)
+			if (x11->uploaded[i].sprite == sprite && x11->uploaded[i].scale == sprite->scale)
+				break;
+		if (i == RENDER_X11_SPRITES) {
+			upload.size = (unsigned long long)sprite->width * sprite->height * sizeof(unsigned int);
+			upload.pixels = (unsigned int *)malloc(upload.size);
+			if (!upload.pixels)
+				return -1;
+			memcpy(upload.pixels, sprite->pixels, upload.size);
+			upload.r = (render_rect_t){ 0, 0, sprite->width, sprite->height };
+
+			for (i=0;i<RENDER_X11_SPRITES && x11->uploaded[i].sprite;i++);
+			if (i == RENDER_X11_SPRITES) {
+				i = x11->nextsprite;
+				x11->nextsprite = (i + 1) % RENDER_X11_SPRITES;
+			}
+			upload.slot = i;
+			x11->uploaded[i].sprite = sprite;
+			x11->uploaded[i].scale = sprite->scale;
+			render_x11_queue(x11, &upload);
+		}
+		cmd.slot = i;
+		cmd.r = (render_rect_t){ x, y, x + sprite->width, y + sprite->height };
+	}
+	render_x11_queue(x11, &cmd);
+
+	return 0;
+}
+#endif
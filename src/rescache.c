@@ -0,0 +1,334 @@
+/*
+ * rescache.c: persistent cache of the images decoded from png-files
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rescache.h"
+
+#define RESCACHE_ALIGN(x)	(((x) + 7) & ~7ULL)
+
+/*
+ *
+ * The cache file is laid out so that it can be used right from where it is
+ * mapped: a header, a table of entries, then for each entry the path of its
+ * png-file, its palette and its indices, at offsets from the start of the
+ * file which are multiples of 8.
+ *
+ */
+typedef struct rescache_header_st {
+	char magic[8];
+	unsigned version;
+	unsigned nentries;
+} rescache_header_t;
+
+typedef struct rescache_entry_st {
+	long long mtime_sec;
+	long long mtime_nsec;
+	long long size;
+	unsigned width;
+	unsigned height;
+	unsigned isize;
+	unsigned ncolors;
+	unsigned long long path;
+	unsigned long long palette;
+	unsigned long long indices;
+} rescache_entry_t;
+
+static const char *map = NULL;		// Cache file as mapped, NULL if none
+static size_t mapsize = 0;
+
+/*
+ *
+ * Return the path of the cache file in the directory for user caches, i.e.,
+ * $XDG_CACHE_HOME, or ~/.cache if unset, or NULL if neither is known. The
+ * string must be freed by the caller.
+ *
+ */
+char *rescache_defaultfile(void)
+{
+	const char *dir = getenv("XDG_CACHE_HOME"), *sub = "/nullify/resources.cache";
+	char *filename = NULL;
+
+
+	if (!dir || *dir != '/') {
+		dir = getenv("HOME");
+		if (!dir || !*dir)
+			return NULL;
+		sub = "/.cache/nullify/resources.cache";
+	}
+
+	filename = (char *)malloc(strlen(dir) + strlen(sub) + 1);
+	if (filename)
+		sprintf(filename, "%s%s", dir, sub);
+
+	return filename;
+}
+
+/*
+ *
+ * Map the cache file @filename in memory, so that the images it holds can be
+ * used without being copied. Nothing is mapped if the file is missing, or if
+ * it was written by another version of the cache. Return 0 on success or -1
+ * otherwise, in which case every look-up misses.
+ *
+ */
+int rescache_open(const char *filename)
+{
+	const rescache_header_t *hdr;
+	struct stat st;
+	void *ptr;
+	int fd;
+
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	if (fstat(fd, &st) || st.st_size < sizeof(rescache_header_t)) {
+		close(fd);
+		return -1;
+	}
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED)
+		return -1;
+
+	hdr = (const rescache_header_t *)ptr;
+	if (memcmp(hdr->magic, RESCACHE_MAGIC, sizeof(hdr->magic)) || hdr->version != RESCACHE_VERSION ||
+	    hdr->nentries > (st.st_size - sizeof(rescache_header_t)) / sizeof(rescache_entry_t)) {
+		munmap(ptr, st.st_size);
+		return -1;
+	}
+
+	map = (const char *)ptr;
+	mapsize = st.st_size;
+	return 0;
+}
+
+/*
+ *
+ * Check that the @len bytes at offset @off lie within the mapped file.
+ *
+ */
+static boolean_t rescache_inside(unsigned long long off, unsigned long long len)
+{
+	return off <= mapsize && len <= mapsize - off ? TRUE : FALSE;
+}
+
+/*
+ *
+ * Look up the png-file @path in the cache. Its canonical path and the time
+ * and size it has now are stored in @image anyway, so that @image can be
+ * filled in and saved later if the file has to be decoded. Return 0 if the
+ * cache holds an image of the file as it is now, in which case @image points
+ * to it, or -1 otherwise. Only the mapped file is read, so that this can be
+ * called from several threads.
+ *
+ */
+int rescache_lookup(const char *path, rescache_image_t *image)
+{
+	const rescache_header_t *hdr = (const rescache_header_t *)map;
+	const rescache_entry_t *e;
+	struct stat st;
+	unsigned i;
+
+
+	memset(image, 0, sizeof(rescache_image_t));
+	if (stat(path, &st) || !realpath(path, image->path))
+		return -1;
+	image->mtime_sec = st.st_mtim.tv_sec;
+	image->mtime_nsec = st.st_mtim.tv_nsec;
+	image->size = st.st_size;
+	if (!map)
+		return -1;
+
+	e = (const rescache_entry_t *)(map + sizeof(rescache_header_t));
+	for (i=0;i<hdr->nentries;i++,e++) {
+		if (!rescache_inside(e->path, strlen(image->path) + 1) || strcmp(map + e->path, image->path))
+			continue;
+
+		if (e->mtime_sec != image->mtime_sec || e->mtime_nsec != image->mtime_nsec || e->size != image->size)
+			return -1;
+		if ((e->isize != 1 && e->isize != 2) ||
+		    !rescache_inside(e->palette, (unsigned long long)e->ncolors * sizeof(unsigned int)) ||
+		    !rescache_inside(e->indices, (unsigned long long)e->width * e->height * e->isize))
+			return -1;
+
+		image->width = e->width;
+		image->height = e->height;
+		image->isize = e->isize;
+		image->ncolors = e->ncolors;
+		image->palette = (const unsigned int *)(map + e->palette);
+		image->indices = map + e->indices;
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ *
+ * Tell whether @ptr points into the mapped cache file, and thus must not be freed.
+ *
+ */
+boolean_t rescache_owns(const void *ptr)
+{
+	return map && (const char *)ptr >= map && (const char *)ptr < map + mapsize ? TRUE : FALSE;
+}
+
+/*
+ *
+ * Create the directories of the path @filename, up to the one the file is
+ * in, if they do not exist yet.
+ *
+ */
+static int rescache_mkdirs(const char *filename)
+{
+	char *dir = NULL, *p;
+	int ret = 0;
+
+
+	dir = strdup(filename);
+	if (!dir)
+		return -1;
+
+	for (p=strchr(dir+1, '/');p && !ret;p=strchr(p+1, '/')) {
+		*p = '\0';
+		if (mkdir(dir, 0700) && errno != EEXIST)
+			ret = -1;
+		*p = '/';
+	}
+	free(dir);
+
+	return ret;
+}
+
+/*
+ *
+ * Write @len bytes at @ptr to @fp, followed by zeroes up to the next
+ * multiple of 8.
+ *
+ */
+static int rescache_write(FILE *fp, const void *ptr, unsigned long long len)
+{
+	static const char zeroes[8] = { 0 };
+
+
+	if (len && fwrite(ptr, len, 1, fp) != 1)
+		return -1;
+	if (RESCACHE_ALIGN(len) != len && fwrite(zeroes, RESCACHE_ALIGN(len) - len, 1, fp) != 1)
+		return -1;
+
+	return 0;
+}
+
+/*
+ *
+ * Replace the cache file @filename with one holding the @n images at
+ * @images, which may point into the current file. The new file is written
+ * next to it, then renamed, so that other instances of the game find either
+ * the old file or the new one, and the mapped one stays valid until
+ * rescache_close() is called. Return 0 on success or -1 on errors.
+ *
+ */
+int rescache_save(const char *filename, const rescache_image_t *images, unsigned n)
+{
+	rescache_header_t hdr = { RESCACHE_MAGIC, RESCACHE_VERSION, n };
+	rescache_entry_t *entries = NULL;
+	unsigned long long off;
+	char *tmpname = NULL;
+	FILE *fp = NULL;
+	unsigned i;
+	int fd, ret = -1;
+
+
+	entries = (rescache_entry_t *)calloc(n ? n : 1, sizeof(rescache_entry_t));
+	tmpname = (char *)malloc(strlen(filename) + strlen(".XXXXXX") + 1);
+	if (!entries || !tmpname || rescache_mkdirs(filename))
+		goto fnreturn;
+
+	off = sizeof(hdr) + n * sizeof(rescache_entry_t);
+	for (i=0;i<n;i++) {
+		entries[i].mtime_sec = images[i].mtime_sec;
+		entries[i].mtime_nsec = images[i].mtime_nsec;
+		entries[i].size = images[i].size;
+		entries[i].width = images[i].width;
+		entries[i].height = images[i].height;
+		entries[i].isize = images[i].isize;
+		entries[i].ncolors = images[i].ncolors;
+		entries[i].path = off;
+		off += RESCACHE_ALIGN(strlen(images[i].path) + 1);
+		entries[i].palette = off;
+		off += RESCACHE_ALIGN(images[i].ncolors * sizeof(unsigned int));
+		entries[i].indices = off;
+		off += RESCACHE_ALIGN((unsigned long long)images[i].width * images[i].height * images[i].isize);
+	}
+
+	sprintf(tmpname, "%s.XXXXXX", filename);
+	fd = mkstemp(tmpname);
+	if (fd == -1)
+		goto fnreturn;
+	fp = fdopen(fd, "wb");
+	if (!fp) {
+		close(fd);
+		unlink(tmpname);
+		goto fnreturn;
+	}
+
+	ret = rescache_write(fp, &hdr, sizeof(hdr)) | rescache_write(fp, entries, n * sizeof(rescache_entry_t));
+	for (i=0;i<n && !ret;i++) {
+		ret |= rescache_write(fp, images[i].path, strlen(images[i].path) + 1);
+		ret |= rescache_write(fp, images[i].palette, images[i].ncolors * sizeof(unsigned int));
+		ret |= rescache_write(fp, images[i].indices,
+				      (unsigned long long)images[i].width * images[i].height * images[i].isize);
+	}
+	if (fclose(fp))
+		ret = -1;
+	if (!ret && rename(tmpname, filename))
+		ret = -1;
+	if (ret)
+		unlink(tmpname);
+
+fnreturn:
+	if (ret)
+		perror(filename);
+	free(entries);
+	free(tmpname);
+	return ret;
+}
+
+/*
+ *
+ * Unmap the cache file, after which the images found in it are gone.
+ *
+ */
+void rescache_close(void)
+{
+	if (map)
+		munmap((void *)map, mapsize);
+	map = NULL;
+	mapsize = 0;
+}
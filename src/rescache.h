@@ -0,0 +1,59 @@
+/*
+ *
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _SRC_RESCACHE_H_
+#define _SRC_RESCACHE_H_
+#ifndef _HAVE_BOOLEAN_T_
+#define _HAVE_BOOLEAN_T_
+typedef enum { FALSE=0, TRUE } boolean_t;
+#endif
+#include <limits.h>
+
+#define RESCACHE_MAGIC		"NLFYRES"	// Followed by a NUL, so that it takes 8 bytes
+#define RESCACHE_VERSION	1
+
+/*
+ *
+ * Image decoded from a png-file, as found in the cache or as it is to be
+ * stored there. The file is identified by its canonical path, and its
+ * modification time and size when it was looked up, which must not have
+ * changed for the image to be used again.
+ *
+ */
+typedef struct rescache_image_st {
+	char path[PATH_MAX];
+	long long mtime_sec;
+	long long mtime_nsec;
+	long long size;
+	unsigned width;
+	unsigned height;
+	unsigned isize;			// Size of each index: 1 byte, or 2
+	unsigned ncolors;
+	const unsigned int *palette;	// 0x00RRGGBB words
+	const void *indices;		// One per pixel, rows being @width indices apart
+} rescache_image_t;
+
+extern char *rescache_defaultfile(void);
+extern int rescache_open(const char *filename);
+extern int rescache_lookup(const char *path, rescache_image_t *image);
+extern boolean_t rescache_owns(const void *ptr);
+extern int rescache_save(const char *filename, const rescache_image_t *images, unsigned n);
+extern void rescache_close(void);
+#endif
@@ -0,0 +1,99 @@
+/*
+ *
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "errorcodes.h"
+#include "../src/dllst.h"
+
+#define NITEMS		100
+
+struct {
+	unsigned a;
+	unsigned unused1;
+	double b;
+} fields = { 0 };
+
+
+int main(int argc, char **argv)
+{
+	int j = 0, ret = 0;
+	dllst_t *dllst = NULL;
+	dllst_item_struct_t *iter, *items[NITEMS];
+
+
+	dllst_verbose = FALSE;
+	dllst = dllst_initlst(dllst, "I:d:");
+	for (j=0;j<NITEMS;j++) {
+		fields.a = j;
+		fields.b = j / 2.0;
+		items[j] = dllst_newitem(dllst, &fields);
+	}
+
+	printf("Checking whether dllst_clear() empties the list... ");
+	dllst_clear(dllst);
+	if (!dllst->size && !dllst->head && !dllst->tail) {
+		printf("yes\n");
+		ret |= 1 << 1;
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	printf("Checking whether new items reuse the memory of the cleared ones... ");
+	fields.a = 1234;
+	fields.b = 0.5;
+	iter = dllst_newitem(dllst, &fields);
+	for (j=0;j<NITEMS;j++)
+		if (iter == items[j])
+			break;
+	if (j < NITEMS && dllst->size == 1 && *(unsigned *)iter->fields == 1234 &&
+	    *((double *)iter->fields + 1) == 0.5) {
+		printf("yes\n");
+		ret |= 1 << 2;
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	printf("Checking whether lists work again after dllst_releasepool()... ");
+	dllst_clear(dllst);
+	dllst_releasepool();
+	for (j=0;j<NITEMS;j++) {
+		fields.a = j;
+		dllst_newitem(dllst, &fields);
+	}
+	for (j=0,iter=dllst->head;iter && *(unsigned *)iter->fields == j;iter=iter->next,j++);
+	if (j == NITEMS && dllst->size == NITEMS && dllst->tail->prev->next == dllst->tail) {
+		printf("yes\n");
+		ret |= 1 << 3;
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+	dllst_clear(dllst);
+	dllst_releasepool();
+
+	if (ret == 0xe)
+		ret = ERR_PASS;
+
+	return ret;
+}
@@ -46,13 +46,21 @@ struct {		// offsets:
 	int d;		// 24
 	int unused3;
 } fields = { 0 }, query = { 0 };
+struct {
+	int x;
+	int unused1;
+	unsigned y;
+	unsigned unused2;
+} pair = { 0 };
 
 
 int main(int argc, char **argv)
 {
 	int j = 0, ret = 0;
-	dllst_t *dllst = NULL;
+	dllst_t *dllst = NULL, *pairs = NULL;
 	dllst_item_struct_t *iter;
+	dllst_sortkey_t keys[2] = { { 0, TRUE }, { 1, FALSE } };
+	dllst_sortkey_t ranged[2] = { { 0, FALSE }, { 1, TRUE } };
 
 
 	dllst_verbose = FALSE;
@@ -112,7 +120,81 @@ int main(int argc, char **argv)
 		ret = ERR_FAIL;
 	}
 
-	if (ret == 6)
+	pairs = dllst_initlst(pairs, "i:I:");
+	for (j=0;j<60;j++) {
+		pair.x = (j * 7) % 5 - 2;
+		pair.y = j;
+		dllst_newitem(pairs, &pair);
+	}
+
+	printf("Checking whether items with equal keys keep their order... ");
+	dllst_sortby(pairs, 0, FALSE);
+	for (iter=pairs->head;iter->next;iter=iter->next)
+		if (*(int *)iter->fields < *(int *)iter->next->fields ||
+		    (*(int *)iter->fields == *(int *)iter->next->fields &&
+		     *((unsigned *)iter->fields + 2) > *((unsigned *)iter->next->fields + 2)))
+			break;
+	if (iter == pairs->tail && pairs->size == 60) {
+		printf("yes\n");
+		ret |= 1 << 3;
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	printf("Sorting by the first field in ascending order, then by the second one in descending order... ");
+	dllst_sortkeys(pairs, keys, 2);
+	for (j=0,iter=pairs->head;iter->next;iter=iter->next,j++)
+		if (*(int *)iter->fields > *(int *)iter->next->fields ||
+		    (*(int *)iter->fields == *(int *)iter->next->fields &&
+		     *((unsigned *)iter->fields + 2) < *((unsigned *)iter->next->fields + 2)) ||
+		    iter != dllst_getitem(pairs, j) || iter->next->prev != iter)
+			break;
+	if (iter == pairs->tail && j == 59) {
+		printf("yes\n");
+		ret |= 1 << 4;
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	printf("Sorting by fields whose range is declared, in linear time... ");
+	iter = NULL;
+	if (!dllst_setrange(pairs, 0, -2, 2) && !dllst_setrange(pairs, 1, 0, 59) &&
+	    dllst_setrange(pairs, 1, 0, 1000) && dllst_setrange(dllst, 2, 0, 9)) {
+		dllst_sortkeys(pairs, ranged, 2);
+		iter = pairs->head;
+	}
+	for (j=0;iter && iter->next;iter=iter->next,j++)
+		if (*(int *)iter->fields < *(int *)iter->next->fields ||
+		    (*(int *)iter->fields == *(int *)iter->next->fields &&
+		     *((unsigned *)iter->fields + 2) > *((unsigned *)iter->next->fields + 2)) ||
+		    iter != dllst_getitem(pairs, j) || iter->next->prev != iter)
+			break;
+	if (iter && iter == pairs->tail && j == 59 && !pairs->head->prev) {
+		printf("yes\n");
+		ret |= 1 << 5;
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	// Values out of the declared range are sorted by comparing them
+	printf("Sorting by a field whose values are out of its declared range... ");
+	dllst_setrange(pairs, 1, 0, 9);
+	dllst_sortby(pairs, 1, FALSE);
+	for (j=0,iter=pairs->head;iter->next;iter=iter->next,j++)
+		if (*((unsigned *)iter->fields + 2) != 59 - j || iter != dllst_getitem(pairs, j))
+			break;
+	if (iter == pairs->tail && j == 59) {
+		printf("yes\n");
+		ret |= 1 << 6;
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	if (ret == 0x7e)
 		ret = ERR_PASS;
 
 	return ret;
@@ -0,0 +1,136 @@
+/*
+ *
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "errorcodes.h"
+#include "../src/dllst.h"
+
+#define NITEMS		300
+#define NROUNDS		2000
+
+struct {
+	unsigned a;
+	unsigned unused1;
+} fields = { 0 };
+
+/*
+ *
+ * Check that walking @l through its links, both ways, visits the same items
+ * that dllst_getitem() returns for each position.
+ *
+ */
+static int check_positions(dllst_t *l)
+{
+	dllst_item_struct_t *iter;
+	unsigned long n;
+
+
+	for (n=0,iter=l->head;iter;iter=iter->next,n++)
+		if (iter != dllst_getitem(l, n) || (n && iter->prev != dllst_getitem(l, n - 1)))
+			return -1;
+	if (n != l->size || (n && l->tail != dllst_getitem(l, n - 1)))
+		return -1;
+	for (iter=l->tail;iter;iter=iter->prev,n--)
+		if (iter != dllst_getitem(l, n - 1))
+			return -1;
+
+	return n ? -1 : 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	int j = 0, ret = 0;
+	unsigned long a, b;
+	dllst_t *dllst = NULL;
+	dllst_item_struct_t *iter;
+
+
+	dllst_verbose = FALSE;
+	srand(1);
+	dllst = dllst_initlst(dllst, "I:");
+	for (j=0;j<NITEMS;j++) {
+		fields.a = j;
+		dllst_newitem(dllst, &fields);
+	}
+
+	printf("Checking whether dllst_swapitems() keeps positions and links in step... ");
+	for (j=0;j<NROUNDS;j++) {
+		a = rand() % dllst->size;
+		b = rand() % 3 ? rand() % dllst->size : a + 1 - (a + 1 == dllst->size) * 2;
+		iter = dllst_getitem(dllst, a);
+		dllst_swapitems(dllst, a, b);
+		if (dllst_getitem(dllst, b) != iter || check_positions(dllst))
+			break;
+	}
+	if (j == NROUNDS) {
+		printf("yes\n");
+		ret |= 1 << 1;
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	printf("Checking whether they stay in step while items come and go... ");
+	for (j=0;j<NROUNDS;j++) {
+		switch (rand() % 4) {
+		case 0:
+			dllst_delitem(dllst, 0);
+			break;
+		case 1:
+			if (dllst->size)
+				dllst_delitem(dllst, rand() % dllst->size);
+			break;
+		default:
+			fields.a = j;
+			dllst_newitem(dllst, &fields);
+			break;
+		}
+		if (check_positions(dllst))
+			break;
+	}
+	if (j == NROUNDS) {
+		printf("yes\n");
+		ret |= 1 << 2;
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	printf("Checking whether dllst_sortby() keeps them in step... ");
+	dllst_sortby(dllst, 0, TRUE);
+	for (iter=dllst->head;iter && iter->next;iter=iter->next)
+		if (*(unsigned *)iter->fields > *(unsigned *)iter->next->fields)
+			break;
+	if (!check_positions(dllst) && iter == dllst->tail) {
+		printf("yes\n");
+		ret |= 1 << 3;
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	if (ret == 0xe)
+		ret = ERR_PASS;
+
+	return ret;
+}
@@ -0,0 +1,132 @@
+/*
+ *
+ * Copyright 2018-2019 Daniel Dwek
+ *
+ * This file is part of nullify.
+ *
+ *  nullify is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nullify is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with nullify.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+#include "../src/render.h"
+#include "errorcodes.h"
+
+/*
+ *
+ * Read back the RGB png-image @filename written by render_savepng() and
+ * return its pixels as 0x00RRGGBB words, or NULL if it is not what was
+ * expected.
+ *
+ */
+unsigned int *read_png(const char *filename, unsigned width, unsigned height)
+{
+	FILE *fp = NULL;
+	png_structp png_ptr = NULL;
+	png_infop info_ptr = NULL;
+	png_bytep row = NULL;
+	unsigned int *pixels = NULL;
+	unsigned x, y;
+
+
+	fp = fopen(filename, "rb");
+	if (!fp)
+		return NULL;
+
+	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	info_ptr = png_create_info_struct(png_ptr);
+	png_init_io(png_ptr, fp);
+	png_read_info(png_ptr, info_ptr);
+	if (png_get_image_width(png_ptr, info_ptr) == width &&
+	    png_get_image_height(png_ptr, info_ptr) == height &&
+	    png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_RGB) {
+		pixels = (unsigned int *)calloc(width * height, sizeof(unsigned int));
+		row = (png_bytep)calloc(width, 3);
+		for (y=0;pixels && row && y<height;y++) {
+			png_read_row(png_ptr, row, NULL);
+			for (x=0;x<width;x++)
+				pixels[y * width + x] = row[x * 3] << 16 | row[x * 3 + 1] << 8 | row[x * 3 + 2];
+		}
+		free(row);
+	}
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	fclose(fp);
+
+	return pixels;
+}
+
+int main(int argc, char **argv)
+{
+	int ret = ERR_PASS;
+	render_frame_t *fr = NULL, *layer = NULL;
+	unsigned int *pixels = NULL;
+	char filename[] = "render_offscreen.png";
+
+
+	fr = render_newframe_mem(64, 48);
+	layer = render_newlayer(fr, 16, 16);
+	if (!fr || !layer)
+		return ERR_HARD;
+
+	printf("Rendering a frame with an overlay in memory... ");
+	render_fill(fr, 0x006600, 0, 0, 64, 48);
+	render_fill(fr, 0xff0000, 8, 8, 16, 16);
+	render_overlay(fr, layer, 16, 16);
+	render_fill(layer, 0x003030, 0, 0, 16, 16);
+	render_fill(fr, 0x0000ff, 20, 20, 4, 4);		// hidden by the layer
+	render_flush(fr);
+	if (render_savepng(fr, filename)) {
+		printf("no\n");
+		return ERR_FAIL;
+	}
+
+	pixels = read_png(filename, 64, 48);
+	remove(filename);
+	if (pixels && pixels[0] == 0x006600 && pixels[10 * 64 + 10] == 0xff0000 &&
+	    pixels[20 * 64 + 20] == 0x003030 && pixels[31 * 64 + 31] == 0x003030 &&
+	    pixels[32 * 64 + 32] == 0x006600) {
+		printf("yes\n");
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+	free(pixels);
+
+	printf("Showing what was below the overlay once removed... ");
+	render_overlay(fr, NULL, 0, 0);
+	render_flush(fr);
+	if (fr->shadow[20 * 64 + 20] == 0x0000ff && fr->shadow[16 * 64 + 16] == 0xff0000 &&
+	    fr->shadow[31 * 64 + 31] == 0x006600) {
+		printf("yes\n");
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	printf("Drawing text with the built-in font... ");
+	render_text(fr, 0xffffff, 0x000000, 0, 20, "|", 1);
+	render_flush(fr);
+	if (fr->shadow[17 * 64 + 2] == 0xffffff && fr->shadow[17 * 64 + 0] == 0x000000) {
+		printf("yes\n");
+	} else {
+		printf("no\n");
+		ret = ERR_FAIL;
+	}
+
+	render_destroyframe(layer);
+	render_destroyframe(fr);
+	return ret;
+}